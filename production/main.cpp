@@ -7,7 +7,10 @@
 #include <set>
 #include <vector>
 
+#include "../src/data/globals.h"
 #include "../src/data/rule.h"
+#include "../src/data/scheduler.h"
+#include "../src/data/threadQueue.h"
 #include "../src/data/tree.h"
 #include "../src/logic.h"
 #include "../src/parse.h"
@@ -29,38 +32,23 @@ static size_t recursion_limit;
 
 static Env *env;
 
-static ThreadQueue *tasks;
+static Scheduler *scheduler;
 static ThreadQueue *results;
 
-extern bool stop_ask;
-
 void handleSigint(int sig) {
-    // Force children to stop and return to runWorker.
-    stop_ask = true;
-
-    // Lock and clear the queues.
-    tasks -> lock();
-    results -> lock();
+    // Only flag the ask as stopped (this is lock free). The workers notice it and clear the queues.
+    env -> cancel -> cancel(CANCEL_INTERRUPT);
 }
 
-void *runWorker (void *unused) {
-    signal(SIGINT, SIG_IGN);
-
-    // This will stop when main returns, so no need to have a variable to force exit.
-    while (true) {
-        // Get a new task to run.
-        ProofTreeNode *node = tasks -> pop();
+void *runWorker (void *worker) {
+    // Only the main thread handles SIGINT. (signal() would change it for the whole process.)
+    sigset_t sigint;
+    sigemptyset(&sigint);
+    sigaddset(&sigint, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigint, NULL);
 
-        if (node == nullptr) break;
-
-        try {
-            ProofTreeNode *result = runAskWorker(env, recursion_limit, node);
-            results -> push(result);
-        } catch (char const *e) {
-            results -> push(nullptr);
-        }
-        
-    }
+    // Runs until the scheduler is shut down.
+    runSchedulerWorker(env, scheduler, results, *(size_t*) worker, recursion_limit);
 
     pthread_exit(NULL);
 }
@@ -85,13 +73,12 @@ void handleIOCommand(istream &in, Env *env) {
 
 int main(int argc, char *argv[]) {
     
-    if (argc > 3) {
-        cerr << "Usage: rilab [num_threads] [recursion_limit]" << endl;
+    if (argc > 7) {
+        cerr << "Usage: rilab [num_threads] [recursion_limit] [search_mode] [heuristic] [timeout] [node_budget]" << endl;
         return -1;
     }
 
     env = new Env();
-    tasks = new ThreadQueue();
     results = new ThreadQueue();
 
     // Setting ask parameters.
@@ -103,15 +90,44 @@ int main(int argc, char *argv[]) {
     if (argc >= 3) recursion_limit = atoi(argv[2]);
     else recursion_limit = 10;
 
-    // Ignore SIGINT in the main thread and force children to stop.
-    // SIGINT should only force the children to stop (in runAsk)
+    if (argc >= 4) {
+        auto mode = rules::search_modes.find(argv[3]);
+
+        if (mode == rules::search_modes.end()) {
+            cerr << "Unknown search mode " << argv[3] << " (expected bfs, iddfs, best or bidir)" << endl;
+            return -1;
+        }
+
+        env -> default_search = mode -> second;
+    }
+
+    if (argc >= 5) {
+        auto heuristic = rules::heuristics.find(argv[4]);
+
+        if (heuristic == rules::heuristics.end()) {
+            cerr << "Unknown heuristic " << argv[4] << " (expected size, overlap or history)" << endl;
+            return -1;
+        }
+
+        env -> default_heuristic = heuristic -> second;
+    }
+
+    // 0 (the default) means no limit
+    if (argc >= 6) env -> timeout = atof(argv[5]);
+    if (argc >= 7) env -> node_budget = atoi(argv[6]);
+
+    // SIGINT stops the current ask instead of the program
     signal(SIGINT, handleSigint);
 
     // Start threads.
+    scheduler = new Scheduler(num_threads);
+
     pthread_t *threads = new pthread_t[num_threads];
+    size_t *worker_ids = new size_t[num_threads];
 
     for (size_t i = 0; i < num_threads; i++) {
-        pthread_create(threads + i, NULL, runWorker, NULL);
+        worker_ids[i] = i;
+        pthread_create(threads + i, NULL, runWorker, worker_ids + i);
     }
 
     // Print basic info about RiLab.
@@ -127,32 +143,26 @@ int main(int argc, char *argv[]) {
 
         if (env -> ask_rule) {
             try {
-                tasks -> unlock();
-                results -> unlock();
-                stop_ask = false;
-                env -> type_var_subs = map<string, string>();
 
-                cout << runAsk(env, tasks, results);
+                cout << runAsk(env, scheduler, results);
             } catch (char const *e) {
                 cerr << e << endl;
             }
 
-            // Empty the queues to avoid stale data
-            tasks -> clear();
-            results -> clear();
         }
     }
 
     // Force all threads to exit
-    for (size_t i = 0; i < num_threads; i++) {
-        tasks -> push(nullptr);
-    }
+    scheduler -> shutdown();
 
     for (size_t i = 0; i < num_threads; i++) {
         pthread_join(threads[i], NULL);
     }
 
     delete[] threads;
+    delete[] worker_ids;
+    delete scheduler;
+    delete results;
     delete env;
 
     return 0;
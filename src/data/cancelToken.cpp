@@ -0,0 +1,48 @@
+#include <atomic>
+#include <chrono>
+
+#include "cancelToken.h"
+
+using std::chrono::duration;
+using std::chrono::duration_cast;
+using std::chrono::steady_clock;
+
+CancelToken::CancelToken() : state(CANCEL_NONE), charged(0), budget(0), has_deadline(false) {}
+
+void CancelToken::reset(double timeout, size_t node_budget) {
+    budget = node_budget;
+    has_deadline = timeout > 0;
+
+    if (has_deadline) {
+        deadline = steady_clock::now() + duration_cast<steady_clock::duration>(duration<double>(timeout));
+    }
+
+    charged.store(0, std::memory_order_relaxed);
+    state.store(CANCEL_NONE, std::memory_order_release);
+}
+
+bool CancelToken::cancel(CancelReason reason) {
+    int expected = CANCEL_NONE;
+    return state.compare_exchange_strong(expected, reason, std::memory_order_acq_rel);
+}
+
+bool CancelToken::cancelled() const {
+    return state.load(std::memory_order_relaxed) != CANCEL_NONE;
+}
+
+CancelReason CancelToken::reason() const {
+    return (CancelReason) state.load(std::memory_order_acquire);
+}
+
+bool CancelToken::charge() {
+    size_t count = charged.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    if (budget > 0 && count > budget) cancel(CANCEL_BUDGET);
+    if (has_deadline && count % CLOCK_INTERVAL == 0 && steady_clock::now() >= deadline) cancel(CANCEL_DEADLINE);
+
+    return cancelled();
+}
+
+size_t CancelToken::nodes() const {
+    return charged.load(std::memory_order_relaxed);
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+// Why an ask was stopped early.
+enum CancelReason {
+    CANCEL_NONE,
+    CANCEL_FOUND,
+    CANCEL_INTERRUPT,
+    CANCEL_DEADLINE,
+    CANCEL_BUDGET
+};
+
+/**
+ * @brief Shared flag that tells the workers to stop the current ask. Thread safe.
+ *
+ * Workers poll cancelled() between steps, which is a single relaxed load, so a stop is
+ * seen within one match. The token also enforces the ask's wall-clock deadline and node
+ * budget as workers charge it for the nodes they process. cancel() is lock free, so it
+ * can be called from a signal handler.
+ */
+class CancelToken {
+    public:
+    CancelToken();
+
+    CancelToken(const CancelToken &other) = delete;
+    CancelToken &operator=(const CancelToken &other) = delete;
+
+    /**
+     * @brief Start a new ask. Not thread safe: only call this while no ask is running.
+     *
+     * @param timeout The wall-clock limit in seconds, or 0 for none.
+     * @param node_budget The max number of nodes to process, or 0 for none.
+     */
+    void reset(double timeout, size_t node_budget);
+
+    // Stop the ask. Only the first reason is kept. Returns true for the call that stopped it.
+    bool cancel(CancelReason reason);
+
+    bool cancelled() const;
+    CancelReason reason() const;
+
+    // Count one processed node, and cancel if the budget or deadline is used up. Returns cancelled().
+    bool charge();
+
+    // The number of nodes charged since the last reset.
+    size_t nodes() const;
+
+    private:
+    // The clock is only read every this many nodes, since it costs more than the rest of charge().
+    static const size_t CLOCK_INTERVAL = 64;
+
+    std::atomic<int> state;
+    std::atomic<size_t> charged;
+
+    size_t budget;
+    bool has_deadline;
+    std::chrono::steady_clock::time_point deadline;
+};
\ No newline at end of file
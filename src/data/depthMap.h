@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+
+#include "term.h"
+
+using std::unordered_map;
+using std::vector;
+
+/**
+ * @brief Concurrent map from goals to a depth, shared by all workers.
+ *
+ * Goals are hash-consed, so the TermId is a canonical key. The map is split into shards,
+ * each behind its own mutex, so workers recording different goals rarely wait on each other.
+ * Term ids are handed out sequentially, so they spread evenly over the shards.
+ *
+ * Keep decides which of two depths for the same goal is kept: Keep()(new, old) is true
+ * when the new depth should replace the old one (std::less keeps the smallest).
+ *
+ * A map with a capacity holds at most capacity / SHARD_COUNT goals per shard (at least one).
+ * Recording a new goal in a full shard forgets the goal that shard has held the longest.
+ */
+template <typename Keep>
+class DepthMap {
+    public:
+    // A capacity of 0 means no limit.
+    explicit DepthMap(size_t capacity = 0) {
+        shard_capacity = capacity == 0 ? 0 : std::max(capacity / SHARD_COUNT, (size_t) 1);
+    }
+
+    ~DepthMap() {
+        for (size_t i = 0; i < SHARD_COUNT; i++) {
+            pthread_mutex_destroy(&shards[i].mtx);
+        }
+    }
+
+    DepthMap(const DepthMap &other) = delete;
+    DepthMap &operator=(const DepthMap &other) = delete;
+
+    /**
+     * @brief Record a depth for a goal, if the goal is new or Keep prefers it to the recorded one.
+     * @return true if the depth was recorded
+     */
+    bool record(TermId goal, size_t depth) {
+        Shard &shard = shards[goal % SHARD_COUNT];
+        bool recorded = false;
+
+        pthread_mutex_lock(&shard.mtx);
+            auto found = shard.depths.find(goal);
+
+            if (found == shard.depths.end()) {
+                // Full, so the oldest goal makes room
+                if (shard_capacity > 0 && shard.order.size() == shard_capacity) {
+                    shard.depths.erase(shard.order[shard.oldest]);
+                    shard.order[shard.oldest] = goal;
+                    shard.oldest = (shard.oldest + 1) % shard_capacity;
+                } else {
+                    shard.order.push_back(goal);
+                }
+
+                shard.depths[goal] = depth;
+                recorded = true;
+            } else if (Keep()(depth, found -> second)) {
+                found -> second = depth;
+                recorded = true;
+            }
+        pthread_mutex_unlock(&shard.mtx);
+
+        return recorded;
+    }
+
+    /**
+     * @brief Get the depth recorded for a goal.
+     * @return false if the goal was never recorded
+     */
+    bool find(TermId goal, size_t &depth) {
+        Shard &shard = shards[goal % SHARD_COUNT];
+
+        pthread_mutex_lock(&shard.mtx);
+            auto found = shard.depths.find(goal);
+            bool known = found != shard.depths.end();
+            if (known) depth = found -> second;
+        pthread_mutex_unlock(&shard.mtx);
+
+        return known;
+    }
+
+    // Forget the goals drop is true for. Not thread safe: only call this while no ask is running.
+    template <typename Drop>
+    void eraseIf(Drop drop) {
+        for (size_t i = 0; i < SHARD_COUNT; i++) {
+            Shard &shard = shards[i];
+            vector<TermId> order;
+
+            // Oldest first, so a full shard's ring is laid out from the start again
+            for (size_t j = 0; j < shard.order.size(); j++) {
+                TermId goal = shard.order[(shard.oldest + j) % shard.order.size()];
+
+                if (drop(goal)) shard.depths.erase(goal);
+                else order.push_back(goal);
+            }
+
+            shard.order = order;
+            shard.oldest = 0;
+        }
+    }
+
+    // Forget all goals. Not thread safe: only call this while no ask is running.
+    void clear() {
+        for (size_t i = 0; i < SHARD_COUNT; i++) {
+            pthread_mutex_lock(&shards[i].mtx);
+                shards[i].depths.clear();
+                shards[i].order.clear();
+                shards[i].oldest = 0;
+            pthread_mutex_unlock(&shards[i].mtx);
+        }
+    }
+
+    // The number of distinct goals recorded.
+    size_t size() {
+        size_t total = 0;
+
+        for (size_t i = 0; i < SHARD_COUNT; i++) {
+            pthread_mutex_lock(&shards[i].mtx);
+                total += shards[i].depths.size();
+            pthread_mutex_unlock(&shards[i].mtx);
+        }
+
+        return total;
+    }
+
+    private:
+    static const size_t SHARD_COUNT = 64;
+
+    struct Shard {
+        pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+        unordered_map<TermId, size_t> depths;
+
+        // The goals in the order they were recorded, as a ring once the shard is full
+        vector<TermId> order;
+        size_t oldest = 0;
+    };
+
+    size_t shard_capacity;
+    Shard shards[SHARD_COUNT];
+};
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include <unordered_map>
+#include <vector>
+
+#include "factStore.h"
+#include "ruleIndex.h"
+
+using std::unordered_map;
+using std::vector;
+
+FactStore::FactStore(const TermStore *terms, const SymbolTable *symbols) {
+    this -> terms = terms;
+    this -> symbols = symbols;
+
+    index = new DiscriminationTree<size_t>(terms, symbols);
+}
+
+FactStore::~FactStore() {
+    delete index;
+}
+
+size_t FactStore::add(Fact fact) {
+    size_t id = facts.size();
+
+    facts.push_back(fact);
+    by_term[fact.term] = id;
+
+    index -> insert(fact.term, id);
+
+    return id;
+}
+
+bool FactStore::contains(TermId term) const {
+    return by_term.find(term) != by_term.end();
+}
+
+size_t FactStore::find(TermId term) const {
+    auto found = by_term.find(term);
+    if (found == by_term.end()) return NO_FACT;
+
+    return found -> second;
+}
+
+vector<size_t> FactStore::candidates(TermId goal) const {
+    return index -> retrieve(goal);
+}
+
+const Fact &FactStore::get(size_t index) const {
+    return facts[index];
+}
+
+size_t FactStore::size() const {
+    return facts.size();
+}
+
+void FactStore::clear() {
+    facts.clear();
+    by_term.clear();
+
+    delete index;
+    index = new DiscriminationTree<size_t>(terms, symbols);
+}
\ No newline at end of file
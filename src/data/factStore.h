@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "ruleIndex.h"
+#include "symbols.h"
+#include "term.h"
+
+using std::unordered_map;
+using std::vector;
+
+const size_t NO_FACT = SIZE_MAX;
+
+// A fact found by forward chaining, and how it was derived.
+struct Fact {
+    TermId term = NO_TERM;
+
+    // The fact this one was derived from, and the rule that was applied (none for axioms).
+    size_t parent = NO_FACT;
+    TermId rule = NO_TERM;
+};
+
+/**
+ * @brief Indexed store of the facts derived by saturate.
+ * Facts are kept in derivation order and indexed in a discrimination tree,
+ * so an ask can look up the facts that might generalize its goal.
+ */
+class FactStore {
+    public:
+    FactStore(const TermStore *terms, const SymbolTable *symbols);
+    ~FactStore();
+
+    FactStore(const FactStore &other) = delete;
+    FactStore &operator=(const FactStore &other) = delete;
+
+    // Add a fact. Returns its index. Not thread safe.
+    size_t add(Fact fact);
+
+    // Check if exactly this term is already a fact.
+    bool contains(TermId term) const;
+
+    // The index of exactly this term, or NO_FACT.
+    size_t find(TermId term) const;
+
+    // Indices of the facts that might generalize the goal, in derivation order.
+    vector<size_t> candidates(TermId goal) const;
+
+    const Fact &get(size_t index) const;
+    size_t size() const;
+
+    // Forget all facts. Not thread safe.
+    void clear();
+
+    private:
+    const TermStore *terms;
+    const SymbolTable *symbols;
+
+    vector<Fact> facts;
+    unordered_map<TermId, size_t> by_term;
+
+    DiscriminationTree<size_t> *index;
+};
\ No newline at end of file
@@ -0,0 +1,25 @@
+#include "failureCache.h"
+#include "term.h"
+
+FailureCache::FailureCache(size_t capacity) : depths(capacity) {}
+
+void FailureCache::fail(TermId goal, size_t remaining) {
+    depths.record(goal, remaining);
+}
+
+bool FailureCache::failed(TermId goal, size_t remaining) {
+    size_t depth;
+    return depths.find(goal, depth) && remaining <= depth;
+}
+
+void FailureCache::clear() {
+    depths.clear();
+}
+
+void FailureCache::forgetScratch() {
+    depths.eraseIf(TermStore::isScratch);
+}
+
+size_t FailureCache::size() {
+    return depths.size();
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+#include "depthMap.h"
+#include "term.h"
+
+using std::greater;
+
+/**
+ * @brief Concurrent table of the goals known to have no proof within some number of steps.
+ * Shared by all workers, and kept across asks for the goals that outlive them.
+ *
+ * Goals are hash-consed, so the TermId is a canonical key. For each goal, the largest
+ * depth it was fully searched to without success is kept: a goal that failed within
+ * d steps also fails within any smaller number of steps. New rules can make a failed goal
+ * provable, so the cache must be cleared whenever a rule is added.
+ *
+ * Every failed node of every ask is recorded, so the cache is bounded: once full, the
+ * oldest failures are forgotten first. A forgotten goal is only searched again.
+ */
+class FailureCache {
+    public:
+    // The number of goals kept by default.
+    static const size_t DEFAULT_CAPACITY = 1 << 16;
+
+    explicit FailureCache(size_t capacity = DEFAULT_CAPACITY);
+
+    FailureCache(const FailureCache &other) = delete;
+    FailureCache &operator=(const FailureCache &other) = delete;
+
+    /**
+     * @brief Record that a goal has no proof of at most the given length.
+     *
+     * @param goal The goal that was searched.
+     * @param remaining The number of rule applications the search was allowed below the goal.
+     */
+    void fail(TermId goal, size_t remaining);
+
+    /**
+     * @brief Check if a goal is known to have no proof of at most the given length.
+     *
+     * @param goal The goal to check.
+     * @param remaining The number of rule applications a search would be allowed below the goal.
+     * @return true if searching the goal again can't succeed, so it can be pruned
+     * @return false if the goal may still be provable
+     */
+    bool failed(TermId goal, size_t remaining);
+
+    // Forget all failures. Not thread safe: only call this while no ask is running.
+    void clear();
+
+    // Forget the failures of goals in the term store's scratch space, before it is dropped.
+    // Not thread safe: only call this while no ask is running.
+    void forgetScratch();
+
+    // The number of distinct goals recorded.
+    size_t size();
+
+    private:
+    // The deepest search each goal failed.
+    DepthMap<greater<size_t>> depths;
+};
\ No newline at end of file
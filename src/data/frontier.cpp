@@ -0,0 +1,44 @@
+#include "frontier.h"
+#include "term.h"
+
+Frontier::Frontier() {
+    goals = new TermStore();
+}
+
+Frontier::~Frontier() {
+    delete goals;
+}
+
+size_t Frontier::add(FrontierStep step) {
+    steps.push_back(step);
+    return steps.size() - 1;
+}
+
+void Frontier::addLeaf(size_t step) {
+    unexpanded.push_back(step);
+}
+
+const FrontierStep &Frontier::get(size_t step) const {
+    return steps[step];
+}
+
+size_t Frontier::size() const {
+    return steps.size();
+}
+
+const vector<size_t> &Frontier::leaves() const {
+    return unexpanded;
+}
+
+bool Frontier::empty() const {
+    return unexpanded.empty();
+}
+
+void Frontier::clear() {
+    ask = NO_TERM;
+    steps.clear();
+    unexpanded.clear();
+
+    delete goals;
+    goals = new TermStore();
+}
\ No newline at end of file
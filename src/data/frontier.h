@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "globals.h"
+#include "term.h"
+
+using std::vector;
+
+const size_t NO_STEP = SIZE_MAX;
+
+// A node on the way from an ask to its frontier: the goal left after applying rule to the parent step's goal.
+// The goal is an id in the frontier's own store, and the rule an id in the env's.
+struct FrontierStep {
+    TermId goal = NO_TERM;
+    TermId rule = NO_TERM;
+    size_t parent = NO_STEP;
+};
+
+/**
+ * @brief The nodes an ask left unexpanded when it ran out of depth, so ask more can continue it.
+ * Not thread safe: it is only written by the worker that finishes the search.
+ *
+ * The proof tree is freed when the ask ends, so only the paths from the root to the
+ * frontier are kept. Each step points to its parent, so shared prefixes are stored once.
+ * Steps are kept in order (parents before children), and the root is step 0.
+ *
+ * The goals of an ask are dropped from the env's term store when it ends, so the frontier
+ * keeps copies of its goals in a store of its own, which is freed by clear().
+ */
+class Frontier {
+    public:
+    Frontier();
+    ~Frontier();
+
+    Frontier(const Frontier &other) = delete;
+    Frontier &operator=(const Frontier &other) = delete;
+
+    // The ask the frontier belongs to (an id in the env's store), and how it was searched.
+    TermId ask = NO_TERM;
+    SearchMode search = SEARCH_BFS;
+    HeuristicKind heuristic = HEURISTIC_SIZE;
+
+    // The goals of the steps.
+    TermStore *goals;
+
+    // Add a step after its parent. Returns its index.
+    size_t add(FrontierStep step);
+
+    // Mark a step as a node that was not expanded.
+    void addLeaf(size_t step);
+
+    const FrontierStep &get(size_t step) const;
+    size_t size() const;
+
+    // The unexpanded steps, in the order they were added.
+    const vector<size_t> &leaves() const;
+
+    // Check if there is anything left to continue.
+    bool empty() const;
+
+    // Forget the frontier.
+    void clear();
+
+    private:
+    vector<FrontierStep> steps;
+    vector<size_t> unexpanded;
+};
\ No newline at end of file
@@ -32,13 +32,35 @@ namespace rules {
         "var", 
         "typevar", 
         "operator", 
+        "conjunction",
         "typename",
         "show",
         "source",
+        "save",
+        "load",
         "literal",
         "true",
         "false",
+        "bfs",
+        "iddfs",
+        "best",
+        "bidir",
+        "more",
+        "saturate",
         ""
     };
 
+    map<string, SearchMode> search_modes = {
+        {"bfs", SEARCH_BFS},
+        {"iddfs", SEARCH_IDDFS},
+        {"best", SEARCH_BEST_FIRST},
+        {"bidir", SEARCH_BIDIRECTIONAL}
+    };
+
+    map<string, HeuristicKind> heuristics = {
+        {"size", HEURISTIC_SIZE},
+        {"overlap", HEURISTIC_OVERLAP},
+        {"history", HEURISTIC_HISTORY}
+    };
+
 }
\ No newline at end of file
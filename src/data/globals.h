@@ -11,6 +11,20 @@ using std::string;
 using std::ostream;
 using std::vector;
 
+// Strategy used to search for a proof.
+enum SearchMode {
+    SEARCH_BFS,
+    SEARCH_IDDFS,
+    SEARCH_BEST_FIRST,
+    SEARCH_BIDIRECTIONAL
+};
+
+// Heuristic used to order nodes in best first mode.
+enum HeuristicKind {
+    HEURISTIC_SIZE,
+    HEURISTIC_OVERLAP,
+    HEURISTIC_HISTORY
+};
 
 namespace rules {
     extern map<string, vector<string>> default_operators;
@@ -18,4 +32,10 @@ namespace rules {
     extern set<string> default_types;
     extern set<string> global_reserved_names;
 
+    // Keywords that select a search mode (eg. ask iddfs <rule>)
+    extern map<string, SearchMode> search_modes;
+
+    // Heuristic names, given after the best keyword (eg. ask best size <rule>)
+    extern map<string, HeuristicKind> heuristics;
+
 }
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include <pthread.h>
+
+#include "meetingTable.h"
+#include "term.h"
+#include "tree.h"
+
+MeetingTable::MeetingTable(const TermStore *terms) : terms(terms) {}
+
+MeetingTable::~MeetingTable() {
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        pthread_mutex_destroy(&shards[i].mtx);
+    }
+
+    pthread_mutex_destroy(&meeting_mtx);
+}
+
+MeetingTable::Shard &MeetingTable::shardFor(SymbolId root) {
+    // Every goal with the same root lands in the same shard, next to the goals it can meet.
+    return shards[root % SHARD_COUNT];
+}
+
+void MeetingTable::addBackward(TermId goal, ProofTreeNode *node, vector<ProofTreeNode*> &partners) {
+    SymbolId root = terms -> get(goal).rule_op;
+    Shard &shard = shardFor(root);
+
+    // Recording and reading happen under the same lock, so when the two halves
+    // reach a meeting point at the same time, the later one always sees the other.
+    pthread_mutex_lock(&shard.mtx);
+        Bucket &bucket = shard.buckets[root];
+        bucket.backward.push_back(node);
+        partners = bucket.forward;
+    pthread_mutex_unlock(&shard.mtx);
+
+    // A fact that is a single variable could generalize any goal. The goal is recorded before
+    // these are read, so a variable fact recorded at the same time still finds the goal.
+    if (root != NO_SYMBOL) {
+        Shard &values = shardFor(NO_SYMBOL);
+
+        pthread_mutex_lock(&values.mtx);
+            auto found = values.buckets.find(NO_SYMBOL);
+            if (found != values.buckets.end()) {
+                partners.insert(partners.end(), found -> second.forward.begin(), found -> second.forward.end());
+            }
+        pthread_mutex_unlock(&values.mtx);
+    }
+}
+
+bool MeetingTable::addForward(TermId fact, ProofTreeNode *node, vector<ProofTreeNode*> &partners) {
+    SymbolId root = terms -> get(fact).rule_op;
+    Shard &shard = shardFor(root);
+    bool fresh = false;
+
+    pthread_mutex_lock(&shard.mtx);
+        Bucket &bucket = shard.buckets[root];
+
+        auto found = bucket.facts.find(fact);
+
+        if (found == bucket.facts.end()) {
+            bucket.facts[fact] = bucket.forward.size();
+            bucket.forward.push_back(node);
+            fresh = true;
+        }
+
+        // A shorter derivation of a known fact. Meeting it can fit proofs the deeper one couldn't.
+        else if (node -> depth < bucket.forward[found -> second] -> depth) {
+            bucket.forward[found -> second] = node;
+            fresh = true;
+        }
+
+        if (fresh) partners = bucket.backward;
+    pthread_mutex_unlock(&shard.mtx);
+
+    // A fact without a root operator (a value) could generalize a goal of any shape, so it meets the goals
+    // with every root. The other buckets are read after the fact is recorded, like in addBackward.
+    if (fresh && root == NO_SYMBOL) {
+        for (size_t i = 0; i < SHARD_COUNT; i++) {
+            pthread_mutex_lock(&shards[i].mtx);
+                for (auto &other : shards[i].buckets) {
+                    if (other.first == NO_SYMBOL) continue;
+                    partners.insert(partners.end(), other.second.backward.begin(), other.second.backward.end());
+                }
+            pthread_mutex_unlock(&shards[i].mtx);
+        }
+    }
+
+    return fresh;
+}
+
+bool MeetingTable::meet(ProofTreeNode *backward, ProofTreeNode *forward) {
+    bool first = false;
+
+    pthread_mutex_lock(&meeting_mtx);
+        if (met_backward == nullptr) {
+            met_backward = backward;
+            met_forward = forward;
+            first = true;
+        }
+    pthread_mutex_unlock(&meeting_mtx);
+
+    return first;
+}
+
+ProofTreeNode *MeetingTable::partner(ProofTreeNode *backward) {
+    ProofTreeNode *forward = nullptr;
+
+    pthread_mutex_lock(&meeting_mtx);
+        if (met_backward == backward) forward = met_forward;
+    pthread_mutex_unlock(&meeting_mtx);
+
+    return forward;
+}
+
+void MeetingTable::clear() {
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        pthread_mutex_lock(&shards[i].mtx);
+            shards[i].buckets.clear();
+        pthread_mutex_unlock(&shards[i].mtx);
+    }
+
+    pthread_mutex_lock(&meeting_mtx);
+        met_backward = nullptr;
+        met_forward = nullptr;
+    pthread_mutex_unlock(&meeting_mtx);
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+
+#include "term.h"
+
+using std::unordered_map;
+using std::vector;
+
+struct ProofTreeNode;
+
+/**
+ * @brief Concurrent table where the two halves of a bidirectional search meet.
+ *
+ * The backward half records the goals it has to prove, and the forward half records the
+ * facts it derived from the axioms. A fact only proves a goal if it generalizes it, and that
+ * needs the root operators to be equal, so nodes are hashed by their root operator. Adding a
+ * node returns the nodes of the other half with the same root, to be matched by the caller.
+ * A fact with no root operator (a single variable) can generalize any goal, so it is returned
+ * for goals of every root, and gets every goal recorded so far.
+ * Each fact keeps only its shallowest derivation, which leaves the most steps for the backward half.
+ */
+class MeetingTable {
+    public:
+    MeetingTable(const TermStore *terms);
+    ~MeetingTable();
+
+    MeetingTable(const MeetingTable &other) = delete;
+    MeetingTable &operator=(const MeetingTable &other) = delete;
+
+    /**
+     * @brief Record a node of the backward search.
+     *
+     * @param goal The node's goal.
+     * @param node The node to record.
+     * @param partners Set to the forward nodes recorded so far whose fact could generalize the goal.
+     */
+    void addBackward(TermId goal, ProofTreeNode *node, vector<ProofTreeNode*> &partners);
+
+    /**
+     * @brief Record a node of the forward search. A fact derived again at a shallower depth
+     * replaces its deeper node, since its derivation is shorter and it has more steps left to expand.
+     *
+     * @param fact The fact derived by the node.
+     * @param node The node to record.
+     * @param partners Set to the backward nodes recorded so far whose goal the fact could generalize.
+     * @return true if the fact is new or shallower than before, and should be expanded
+     * @return false if the fact was already derived at the same depth or above (nothing is recorded)
+     */
+    bool addForward(TermId fact, ProofTreeNode *node, vector<ProofTreeNode*> &partners);
+
+    // Claim the meeting of two nodes. Only the first claim since clear() succeeds.
+    bool meet(ProofTreeNode *backward, ProofTreeNode *forward);
+
+    // The forward node that met the given backward node, or nullptr.
+    ProofTreeNode *partner(ProofTreeNode *backward);
+
+    // Forget all nodes and the meeting. Not thread safe: only call this while no ask is running.
+    void clear();
+
+    private:
+    static const size_t SHARD_COUNT = 64;
+
+    struct Bucket {
+        vector<ProofTreeNode*> backward;
+        vector<ProofTreeNode*> forward;
+
+        // The index in forward of the node recording each fact.
+        unordered_map<TermId, size_t> facts;
+    };
+
+    struct Shard {
+        pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+        unordered_map<SymbolId, Bucket> buckets;
+    };
+
+    const TermStore *terms;
+    Shard shards[SHARD_COUNT];
+
+    pthread_mutex_t meeting_mtx = PTHREAD_MUTEX_INITIALIZER;
+    ProofTreeNode *met_backward = nullptr;
+    ProofTreeNode *met_forward = nullptr;
+
+    Shard &shardFor(SymbolId root);
+};
\ No newline at end of file
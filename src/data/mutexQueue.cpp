@@ -0,0 +1,61 @@
+#include <iostream>
+#include <pthread.h>
+#include <utility>
+
+#include "mutexQueue.h"
+#include "tree.h"
+
+MutexQueue::~MutexQueue() {
+    pthread_mutex_destroy(&mtx);
+    pthread_cond_destroy(&q_empty);
+}
+
+void MutexQueue::push(ProofTreeNode *node) {
+    pthread_mutex_lock(&mtx);
+        q.push(node);
+        size++;
+
+        pthread_cond_broadcast(&q_empty);
+    pthread_mutex_unlock(&mtx);
+}
+
+ProofTreeNode *MutexQueue::pop() {
+    pthread_mutex_lock(&mtx);
+        while (size == 0 && !locked) pthread_cond_wait(&q_empty, &mtx);
+        if (locked) {
+            pthread_mutex_unlock(&mtx);
+            return nullptr;
+        }
+
+        ProofTreeNode *front = q.front();
+        q.pop();
+
+        size--;
+
+    pthread_mutex_unlock(&mtx);    
+
+    return front;
+}
+
+void MutexQueue::lock() {
+    clear();
+    pthread_mutex_lock(&mtx);
+        locked = true;
+        pthread_cond_broadcast(&q_empty);
+    pthread_mutex_unlock(&mtx);
+}
+
+void MutexQueue::unlock() {
+    pthread_mutex_lock(&mtx);
+        locked = false;
+    pthread_mutex_unlock(&mtx);
+}
+
+void MutexQueue::clear() {
+    pthread_mutex_lock(&mtx);
+        queue<ProofTreeNode*> newq = queue<ProofTreeNode*>();
+        std::swap(q, newq);
+
+        size = 0;
+    pthread_mutex_unlock(&mtx);    
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <pthread.h>
+#include <queue>
+
+#include "tree.h"
+
+using std::queue;
+
+// Producer-Consumer Queue with no max size. Thread safe.
+// The original mutex and condition variable version of ThreadQueue, kept for benchmarking.
+class MutexQueue {
+    public:
+    MutexQueue() = default;
+    ~MutexQueue();
+
+    void push(ProofTreeNode *node);
+    ProofTreeNode *pop();
+
+    void clear();
+
+    void lock();
+    void unlock();
+
+    private:
+    queue<ProofTreeNode*> q = queue<ProofTreeNode*>();
+
+    size_t size = 0;
+
+    pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t q_empty = PTHREAD_COND_INITIALIZER;
+
+    bool locked = false;
+};
\ No newline at end of file
@@ -57,7 +57,7 @@ bool operator==(const RuleTree &fst, const RuleTree &snd) {
     if (fst.sub_rules.size() != snd.sub_rules.size()) return false;
 
     for (size_t i = 0; i < fst.sub_rules.size(); i++) {
-        if (!(fst.sub_rules[i] == snd.sub_rules[i])) return false;
+        if (!(*fst.sub_rules[i] == *snd.sub_rules[i])) return false;
     }
 
     return true;
@@ -77,11 +77,33 @@ Env::Env() {
 
     variables = map<string, string>(); 
     literals = map<string, string>();
+    conjunctions = set<string>();
 
     rules = set<RuleTree*>();
 
+    symbols = new SymbolTable();
+    terms = new TermStore();
+    rule_terms = vector<TermId>();
+    rule_index = new RuleIndex(terms, symbols);
+    facts = new FactStore(terms, symbols);
+    lemmas = new FactStore(terms, symbols);
+    failures = new FailureCache();
+    frontier = new Frontier();
+
     ask_rule = nullptr;
-    type_var_subs = map<string, string>();
+    ask_more = 0;
+    ask_search = SEARCH_BFS;
+    default_search = SEARCH_BFS;
+    ask_heuristic = HEURISTIC_SIZE;
+    default_heuristic = HEURISTIC_SIZE;
+    rule_successes = map<TermId, size_t>();
+    visited = new VisitedTable();
+    meetings = new MeetingTable(terms);
+    splits = new SplitTable();
+    sources = new SourceManager();
+    cancel = new CancelToken();
+    timeout = 0;
+    node_budget = 0;
 }
 
 Env::Env(const Env &other) {
@@ -92,15 +114,37 @@ Env::Env(const Env &other) {
 
     variables = other.variables; 
     literals = other.literals;
+    conjunctions = other.conjunctions;
 
     rules = set<RuleTree*>();
 
-    for (RuleTree *r : other.rules) {
-        rules.insert(new RuleTree(*r));
+    symbols = new SymbolTable();
+    terms = new TermStore();
+    rule_terms = vector<TermId>();
+    rule_index = new RuleIndex(terms, symbols);
+    facts = new FactStore(terms, symbols);
+    lemmas = new FactStore(terms, symbols);
+    failures = new FailureCache();
+    frontier = new Frontier();
+
+    for (TermId r : other.rule_terms) {
+        addRule(other.toRuleTree(r));
     }
 
     ask_rule = nullptr;
-    type_var_subs = map<string, string>();    
+    ask_more = 0;
+    ask_search = other.default_search;
+    default_search = other.default_search;
+    ask_heuristic = other.default_heuristic;
+    default_heuristic = other.default_heuristic;
+    rule_successes = map<TermId, size_t>();
+    visited = new VisitedTable();
+    meetings = new MeetingTable(terms);
+    splits = new SplitTable();
+    sources = new SourceManager(*other.sources);
+    cancel = new CancelToken();
+    timeout = other.timeout;
+    node_budget = other.node_budget;
 }
 
 Env &Env::operator=(const Env &other) {
@@ -112,15 +156,48 @@ Env &Env::operator=(const Env &other) {
 
         variables = other.variables; 
         literals = other.literals;
+        conjunctions = other.conjunctions;
+
+        for (RuleTree *r : rules) {
+            delete r;
+        }
 
         rules = set<RuleTree*>();
 
-        for (RuleTree *r : other.rules) {
-            rules.insert(new RuleTree(*r));
+        delete meetings;
+        delete frontier;
+        delete failures;
+        delete lemmas;
+        delete facts;
+        delete rule_index;
+        delete terms;
+        delete symbols;
+        symbols = new SymbolTable();
+        terms = new TermStore();
+        rule_terms = vector<TermId>();
+        rule_index = new RuleIndex(terms, symbols);
+        facts = new FactStore(terms, symbols);
+        lemmas = new FactStore(terms, symbols);
+        failures = new FailureCache();
+        frontier = new Frontier();
+        meetings = new MeetingTable(terms);
+
+        for (TermId r : other.rule_terms) {
+            addRule(other.toRuleTree(r));
         }
 
         ask_rule = nullptr;
-        type_var_subs = map<string, string>();
+        ask_more = 0;
+        ask_search = other.default_search;
+        default_search = other.default_search;
+        ask_heuristic = other.default_heuristic;
+        default_heuristic = other.default_heuristic;
+        rule_successes = map<TermId, size_t>();
+        visited -> clear();
+        splits -> clear();
+        *sources = *other.sources;
+        timeout = other.timeout;
+        node_budget = other.node_budget;
     }
 
     return *this;
@@ -131,7 +208,19 @@ Env::~Env() {
         delete r;
     }
 
+    delete frontier;
+    delete failures;
+    delete lemmas;
+    delete facts;
+    delete rule_index;
+    delete terms;
+    delete symbols;
     delete ask_rule;
+    delete visited;
+    delete meetings;
+    delete splits;
+    delete sources;
+    delete cancel;
 }
 
 ostream &operator<<(ostream &os, const RuleTree &r) {
@@ -177,7 +266,93 @@ bool Env::isOpName(string name) {
     operators.find(name) != operators.end();
 }
 
-ostream &operator<<(ostream &os, Env env) {
+void Env::addRule(RuleTree *rule) {
+    rules.insert(rule);
+    addRule(intern(rule));
+}
+
+void Env::addRule(TermId rule) {
+    rule_terms.push_back(rule);
+    rule_index -> addRule(rule);
+
+    // The new rule may prove goals that failed before, or apply to nodes that were already expanded
+    failures -> clear();
+    frontier -> clear();
+}
+
+void Env::addConjunction(string op) {
+    conjunctions.insert(op);
+
+    // Goals built with the operator can be split now, which may prove goals that failed before
+    failures -> clear();
+    frontier -> clear();
+}
+
+SymbolId Env::symbol(const string &name) {
+    SymbolId id = symbols -> intern(name);
+
+    // Names can only be declared once, so a kind never changes after it's set.
+    if (symbols -> kind(id) != SYMBOL_NONE) return id;
+
+    if      (type_vars.find(name) != type_vars.end()) symbols -> setKind(id, SYMBOL_TYPEVAR);
+    else if (isTypeName(name))                        symbols -> setKind(id, SYMBOL_TYPE);
+    else if (isOpName(name))                          symbols -> setKind(id, SYMBOL_OPERATOR);
+    else if (literals.find(name) != literals.end())   symbols -> setKind(id, SYMBOL_LITERAL);
+    else if (variables.find(name) != variables.end()) symbols -> setKind(id, SYMBOL_VARIABLE);
+
+    return id;
+}
+
+TermId Env::intern(const RuleTree *rule) {
+    Term term;
+    term.rule_type = symbol(rule -> rule_type);
+    term.rule_value = symbol(rule -> rule_value);
+    term.rule_op = symbol(rule -> rule_op);
+
+    for (RuleTree *child : rule -> sub_rules) {
+        term.sub_terms.push_back(intern(child));
+    }
+
+    return terms -> make(term);
+}
+
+RuleTree *Env::toRuleTree(TermId id) const {
+    const Term &term = terms -> get(id);
+
+    RuleTree *rule = new RuleTree();
+    rule -> rule_type = symbols -> name(term.rule_type);
+    rule -> rule_value = symbols -> name(term.rule_value);
+    rule -> rule_op = symbols -> name(term.rule_op);
+
+    for (TermId child : term.sub_terms) {
+        rule -> sub_rules.push_back(toRuleTree(child));
+    }
+
+    return rule;
+}
+
+void Env::printTerm(ostream &os, TermId id) const {
+    const Term &term = terms -> get(id);
+
+    os << "(";
+
+    // Either the term has a value, or children
+    if (term.rule_value != NO_SYMBOL) {
+        os << symbols -> name(term.rule_type);
+        os << " ";
+        os << symbols -> name(term.rule_value);
+    } else {
+        os << symbols -> name(term.rule_op);
+        for (TermId child : term.sub_terms) {
+            os << " ";
+            printTerm(os, child);
+        }
+    }
+
+    os << ")";
+}
+
+ostream &operator<<(ostream &os, const Env &env) {
     os << "Current env" << endl << "-------" << endl;
 
     os << endl << "Type Names (Local)" << endl << "-----" << endl;
@@ -250,9 +425,17 @@ ostream &operator<<(ostream &os, Env env) {
         os << endl;
     }
 
+    if (!env.conjunctions.empty()) {
+        os << endl << "Conjunctions" << endl << "-----" << endl;
+        for (string s : env.conjunctions) {
+            os << s << endl;
+        }
+    }
+
     os << endl << "Rules" << endl << "-----" << endl;
-    for (RuleTree *r : env.rules) {
-        os << *r << endl;
+    for (TermId r : env.rule_terms) {
+        env.printTerm(os, r);
+        os << endl;
     }
 
     return os;
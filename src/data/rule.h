@@ -6,6 +6,19 @@
 #include <string>
 #include <vector>
 
+#include "cancelToken.h"
+#include "factStore.h"
+#include "failureCache.h"
+#include "frontier.h"
+#include "globals.h"
+#include "meetingTable.h"
+#include "ruleIndex.h"
+#include "sourceManager.h"
+#include "splitTable.h"
+#include "symbols.h"
+#include "term.h"
+#include "visitedTable.h"
+
 using std::map;
 using std::set;
 using std::string;
@@ -47,11 +60,69 @@ struct Env {
     // Literals are like variables except you can't substitute one for another
     map<string, string> literals;
 
+    // Operators declared as conjunctions. Asks prove each side of their goals separately.
+    set<string> conjunctions;
+
+    // The parsed rules, owned by the env. Rules loaded from a snapshot only exist as terms.
     set<RuleTree*> rules;
 
+    // Interned names and hash-consed copies of the rules above (in declaration order).
+    // The prover works on these ids rather than on strings. The goals an ask makes are
+    // interned in the store's scratch space, which runAsk drops when the ask ends.
+    SymbolTable *symbols;
+    TermStore *terms;
+    vector<TermId> rule_terms;
+
+    // Index over rule_terms, so the prover only tries rules that can match a goal.
+    RuleIndex *rule_index;
+
+    // Facts derived from the rules by the last saturate. Asks check these before searching.
+    FactStore *facts;
+
+    // Goals proven by earlier asks, with their proofs. The search stops at any goal one of them generalizes.
+    FactStore *lemmas;
+
+    // Goals known to have no proof within some depth, shared by all workers and asks.
+    // Cleared by addRule, by saturate, and whenever an ask adds a lemma.
+    FailureCache *failures;
+
     // Used for running an ask
     RuleTree *ask_rule;
-    map<string, string> type_var_subs;
+
+    // The nodes the last ask left unexpanded when it ran out of depth. Cleared by addRule and by every new ask.
+    Frontier *frontier;
+
+    // Levels ask more continues the frontier by (at most the recursion limit), or 0 for a new ask.
+    size_t ask_more;
+
+    // The search mode of the current ask, and the one used when the ask doesn't name one.
+    SearchMode ask_search;
+    SearchMode default_search;
+
+    HeuristicKind ask_heuristic;
+    HeuristicKind default_heuristic;
+
+    // How often each rule was used in a proof found so far (for the history heuristic).
+    map<TermId, size_t> rule_successes;
+
+    // Goals already reached by the current ask, shared by all workers. Cleared by runAsk.
+    VisitedTable *visited;
+
+    // Where the two halves of a bidirectional ask meet. Cleared by runAsk.
+    MeetingTable *meetings;
+
+    // The conjunctions split by the current ask, and the proofs of their sides. Cleared by runAsk.
+    SplitTable *splits;
+
+    // The files sourced into this env, and the declarations of the ones that can be merged again without parsing.
+    SourceManager *sources;
+
+    // Stops the workers when the current ask is done, interrupted or out of time/nodes. Reset by runAsk.
+    CancelToken *cancel;
+
+    // Limits for every ask: wall-clock seconds and nodes processed (0 for no limit).
+    double timeout;
+    size_t node_budget;
 
     Env();
     Env(const Env &other);
@@ -74,8 +145,38 @@ struct Env {
     // Check if the name is an operator name.
     bool isOpName(string name);
 
+    // Add a (type checked) rule to the env. The env takes ownership of the rule. Clears the failure cache and the frontier.
+    void addRule(RuleTree *rule);
+
+    // Add a rule that is already interned (and type checked). Clears the failure cache and the frontier.
+    void addRule(TermId rule);
+
+    // Mark an operator as a conjunction. Clears the failure cache and the frontier.
+    void addConjunction(string op);
+
+    /**
+     * @brief Get the symbol id for a name, tagging it with its kind in this env.
+     * Not thread safe: only call this while no ask is running.
+     */
+    SymbolId symbol(const string &name);
+
+    /**
+     * @brief Intern a rule tree into the env's term store.
+     * Not thread safe: only call this while no ask is running.
+     * 
+     * @param rule The rule to intern. It is not modified.
+     * @return TermId The id of the (possibly pre-existing) term.
+     */
+    TermId intern(const RuleTree *rule);
+
+    // Build a standalone (deep-copied) rule tree from a term. The caller owns the result.
+    RuleTree *toRuleTree(TermId id) const;
+
+    // Print a term in the same format as RuleTree's operator<<.
+    void printTerm(ostream &os, TermId id) const;
+
     /**
      * @brief Print out an env, including all rules, vars, etc.
      */
-    friend ostream &operator<<(ostream &os, Env env);
+    friend ostream &operator<<(ostream &os, const Env &env);
 };
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ruleIndex.h"
+#include "symbols.h"
+#include "term.h"
+
+using std::pair;
+using std::sort;
+using std::vector;
+
+// Edge labels are (tag << 32) | symbol.
+static const uint64_t OPERATOR_KEY = 1ULL << 32;
+static const uint64_t VALUE_KEY = 2ULL << 32;
+
+static const uint64_t WILDCARD_KEY = UINT64_MAX;
+
+template <typename Value>
+DiscriminationTree<Value>::DiscriminationTree(const TermStore *terms, const SymbolTable *symbols) {
+    this -> terms = terms;
+    this -> symbols = symbols;
+
+    root = new Node();
+}
+
+template <typename Value>
+DiscriminationTree<Value>::~DiscriminationTree() {
+    destroy(root);
+}
+
+template <typename Value>
+void DiscriminationTree<Value>::destroy(Node *node) {
+    if (node == nullptr) return;
+
+    for (auto i = node -> children.begin(); i != node -> children.end(); ++i) {
+        destroy(i -> second);
+    }
+
+    destroy(node -> wildcard);
+    delete node;
+}
+
+template <typename Value>
+bool DiscriminationTree<Value>::isPatternVariable(const Term &term) const {
+    // Anything but a literal can be bound by generalize, so it matches a whole subterm.
+    return term.rule_value != NO_SYMBOL && symbols -> kind(term.rule_value) != SYMBOL_LITERAL;
+}
+
+template <typename Value>
+uint64_t DiscriminationTree<Value>::key(const Term &term) const {
+    if (term.rule_value != NO_SYMBOL) return VALUE_KEY | term.rule_value;
+    return OPERATOR_KEY | term.rule_op;
+}
+
+template <typename Value>
+void DiscriminationTree<Value>::insert(TermId pattern, Value value) {
+    // Preorder walk of the pattern, where variables become wildcard edges.
+    vector<TermId> stack = {pattern};
+    Node *current = root;
+
+    while (!stack.empty()) {
+        const Term &term = terms -> get(stack.back());
+        stack.pop_back();
+
+        if (isPatternVariable(term)) {
+            if (current -> wildcard == nullptr) current -> wildcard = new Node();
+            current = current -> wildcard;
+            continue;
+        }
+
+        uint64_t edge = key(term);
+        auto found = current -> children.find(edge);
+
+        if (found == current -> children.end()) {
+            Node *child = new Node();
+            current -> children[edge] = child;
+            current = child;
+        } else {
+            current = found -> second;
+        }
+
+        for (size_t i = term.sub_terms.size(); i > 0; i--) {
+            stack.push_back(term.sub_terms[i - 1]);
+        }
+    }
+
+    current -> values.push_back({count, value});
+    count++;
+}
+
+template <typename Value>
+void DiscriminationTree<Value>::flatten(TermId id, vector<uint64_t> &keys, vector<size_t> &skips) const {
+    const Term &term = terms -> get(id);
+
+    size_t pos = keys.size();
+    keys.push_back(key(term));
+    skips.push_back(0);
+
+    for (TermId child : term.sub_terms) {
+        flatten(child, keys, skips);
+    }
+
+    // Where the goal continues after this subterm (used by wildcard edges)
+    skips[pos] = keys.size();
+}
+
+template <typename Value>
+void DiscriminationTree<Value>::collect(const Node *node, size_t pos, const vector<uint64_t> &keys,
+    const vector<size_t> &skips, vector<pair<size_t, Value>> &out) const {
+
+    if (pos == keys.size()) {
+        out.insert(out.end(), node -> values.begin(), node -> values.end());
+        return;
+    }
+
+    if (node -> wildcard != nullptr) {
+        collect(node -> wildcard, skips[pos], keys, skips, out);
+    }
+
+    auto found = node -> children.find(keys[pos]);
+    if (found != node -> children.end()) {
+        collect(found -> second, pos + 1, keys, skips, out);
+    }
+}
+
+template <typename Value>
+vector<Value> DiscriminationTree<Value>::retrieve(TermId goal) const {
+    vector<uint64_t> keys;
+    vector<size_t> skips;
+    flatten(goal, keys, skips);
+
+    vector<pair<size_t, Value>> found;
+    collect(root, 0, keys, skips, found);
+
+    // Keep results in the order they were inserted (the order rules were declared, or facts derived)
+    sort(found.begin(), found.end(), [](const pair<size_t, Value> &fst, const pair<size_t, Value> &snd) {
+        return fst.first < snd.first;
+    });
+
+    vector<Value> out;
+    for (auto &entry : found) out.push_back(entry.second);
+
+    return out;
+}
+
+template <typename Value>
+size_t DiscriminationTree<Value>::size() const {
+    return count;
+}
+
+// The trees used by the rule index and by fact stores.
+template class DiscriminationTree<RuleCandidate>;
+template class DiscriminationTree<size_t>;
+
+RuleIndex::RuleIndex(const TermStore *terms, const SymbolTable *symbols)
+    : whole_rules(terms, symbols), conclusions(terms, symbols), premises(terms, symbols) {
+    this -> terms = terms;
+}
+
+void RuleIndex::addRule(TermId rule) {
+    const Term &term = terms -> get(rule);
+
+    RuleCandidate whole;
+    whole.rule = rule;
+    whole_rules.insert(rule, whole);
+
+    // Mirrors applyRule: --> matches its right side, --<> matches either side.
+    if (term.rule_op == IMPLIES_SYMBOL || term.rule_op == EQUIV_SYMBOL) {
+        RuleCandidate forward;
+        forward.rule = rule;
+        forward.direction = true;
+        conclusions.insert(term.sub_terms[1], forward);
+        premises.insert(term.sub_terms[0], forward);
+    }
+
+    if (term.rule_op == EQUIV_SYMBOL) {
+        RuleCandidate backward;
+        backward.rule = rule;
+        backward.direction = false;
+        conclusions.insert(term.sub_terms[0], backward);
+        premises.insert(term.sub_terms[1], backward);
+    }
+
+    if (term.rule_op != IMPLIES_SYMBOL && term.rule_op != EQUIV_SYMBOL) addFactSymbols(rule);
+}
+
+void RuleIndex::addFactSymbols(TermId id) {
+    const Term &term = terms -> get(id);
+
+    if (term.rule_op != NO_SYMBOL) fact_symbols.insert(term.rule_op);
+    if (term.rule_value != NO_SYMBOL) fact_symbols.insert(term.rule_value);
+
+    for (TermId child : term.sub_terms) {
+        addFactSymbols(child);
+    }
+}
+
+bool RuleIndex::inFact(SymbolId symbol) const {
+    return fact_symbols.find(symbol) != fact_symbols.end();
+}
+
+vector<TermId> RuleIndex::matchingRules(TermId goal) const {
+    vector<TermId> out;
+
+    for (RuleCandidate candidate : whole_rules.retrieve(goal)) {
+        out.push_back(candidate.rule);
+    }
+
+    return out;
+}
+
+vector<RuleCandidate> RuleIndex::applicableRules(TermId goal) const {
+    return conclusions.retrieve(goal);
+}
+
+vector<RuleCandidate> RuleIndex::forwardRules(TermId fact) const {
+    return premises.retrieve(fact);
+}
\ No newline at end of file
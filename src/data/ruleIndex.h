@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "symbols.h"
+#include "term.h"
+
+using std::pair;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+// A rule that might apply to a goal, and which side of it to match against (see applyRule).
+struct RuleCandidate {
+    TermId rule = NO_TERM;
+    bool direction = true;
+};
+
+/**
+ * @brief Discrimination tree over term patterns.
+ * Each pattern is stored as its preorder list of symbols, with every variable
+ * collapsed into a single wildcard edge that skips a whole subterm of the goal.
+ *
+ * Types are not indexed, so retrieve() returns a superset of the patterns that
+ * generalize the goal. Callers still need to run generalize on each result.
+ *
+ * Value is what each pattern maps to: a RuleCandidate in the rule index, or a fact's index in a FactStore.
+ */
+template <typename Value>
+class DiscriminationTree {
+    public:
+    DiscriminationTree(const TermStore *terms, const SymbolTable *symbols);
+    ~DiscriminationTree();
+
+    DiscriminationTree(const DiscriminationTree &other) = delete;
+    DiscriminationTree &operator=(const DiscriminationTree &other) = delete;
+
+    // Add a pattern. Not thread safe, but may run concurrently with nothing else.
+    void insert(TermId pattern, Value value);
+
+    /**
+     * @brief Find every value whose pattern could generalize the goal.
+     *
+     * @param goal The (specific) term to look up.
+     * @return vector<Value> The values, in insertion order.
+     */
+    vector<Value> retrieve(TermId goal) const;
+
+    size_t size() const;
+
+    private:
+    struct Node {
+        unordered_map<uint64_t, Node*> children;
+        Node *wildcard = nullptr;
+
+        // (insertion order, value) for patterns that end here
+        vector<pair<size_t, Value>> values;
+    };
+
+    const TermStore *terms;
+    const SymbolTable *symbols;
+
+    Node *root;
+    size_t count = 0;
+
+    uint64_t key(const Term &term) const;
+    bool isPatternVariable(const Term &term) const;
+
+    void flatten(TermId id, vector<uint64_t> &keys, vector<size_t> &skips) const;
+    void collect(const Node *node, size_t pos, const vector<uint64_t> &keys,
+        const vector<size_t> &skips, vector<pair<size_t, Value>> &out) const;
+
+    void destroy(Node *node);
+};
+
+/**
+ * @brief Index over the env's rules, built incrementally as rules are declared.
+ * Lets the prover retrieve only the rules whose shape could match a goal,
+ * instead of trying generalize against every rule.
+ */
+class RuleIndex {
+    public:
+    RuleIndex(const TermStore *terms, const SymbolTable *symbols);
+
+    // Index a (type checked) rule. Not thread safe.
+    void addRule(TermId rule);
+
+    // Rules that might generalize the goal as a whole (ie, the goal is already proven).
+    vector<TermId> matchingRules(TermId goal) const;
+
+    // Rules (and directions) whose conclusion might generalize the goal.
+    vector<RuleCandidate> applicableRules(TermId goal) const;
+
+    // Rules whose premise might generalize a fact (for forward chaining).
+    // direction is true to derive the right side from the left side, false for the reverse.
+    vector<RuleCandidate> forwardRules(TermId fact) const;
+
+    // Check if an operator or value appears in any fact (a rule that isn't --> or --<>).
+    bool inFact(SymbolId symbol) const;
+
+    private:
+    const TermStore *terms;
+
+    unordered_set<SymbolId> fact_symbols;
+
+    void addFactSymbols(TermId id);
+
+    DiscriminationTree<RuleCandidate> whole_rules;
+    DiscriminationTree<RuleCandidate> conclusions;
+    DiscriminationTree<RuleCandidate> premises;
+};
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <deque>
+#include <pthread.h>
+#include <vector>
+
+#include "scheduler.h"
+#include "tree.h"
+
+using std::deque;
+using std::vector;
+
+// Heap order for prioritized mode: the cheapest node ends up at the front.
+static bool costlier(const ProofTreeNode *fst, const ProofTreeNode *snd) {
+    return fst -> cost > snd -> cost;
+}
+
+Scheduler::Scheduler(size_t workers) {
+    if (workers == 0) workers = 1;
+
+    for (size_t i = 0; i < workers; i++) {
+        queues.push_back(new WorkerQueue());
+        arenas.push_back(new NodeArena());
+    }
+
+    pending = 0;
+    sleeping = 0;
+
+    locked = false;
+    stopped = false;
+    prioritized = false;
+}
+
+Scheduler::~Scheduler() {
+    for (WorkerQueue *q : queues) {
+        pthread_mutex_destroy(&q -> mtx);
+        delete q;
+    }
+
+    for (NodeArena *a : arenas) {
+        delete a;
+    }
+
+    pthread_mutex_destroy(&idle_mtx);
+    pthread_cond_destroy(&has_work);
+    pthread_cond_destroy(&drained);
+}
+
+void Scheduler::push(size_t worker, ProofTreeNode *node) {
+    WorkerQueue *q = queues[worker % queues.size()];
+
+    // Checked under the queue lock, so lock() either sees this node or we see the flag
+    pthread_mutex_lock(&q -> mtx);
+        if (locked) {
+            pthread_mutex_unlock(&q -> mtx);
+            return;
+        }
+
+        pending++;
+        q -> nodes.push_back(node);
+
+        if (prioritized) std::push_heap(q -> nodes.begin(), q -> nodes.end(), costlier);
+    pthread_mutex_unlock(&q -> mtx);
+
+    // Only pay for the idle lock if someone is asleep
+    if (sleeping > 0) {
+        pthread_mutex_lock(&idle_mtx);
+            pthread_cond_signal(&has_work);
+        pthread_mutex_unlock(&idle_mtx);
+    }
+}
+
+ProofTreeNode *Scheduler::take(size_t worker) {
+    if (locked) return nullptr;
+
+    size_t count = queues.size();
+
+    // Own deque first (oldest node), then steal the newest node from the others.
+    // In prioritized mode, the cheapest node is taken either way.
+    for (size_t i = 0; i < count; i++) {
+        WorkerQueue *q = queues[(worker + i) % count];
+        ProofTreeNode *node = nullptr;
+
+        pthread_mutex_lock(&q -> mtx);
+            if (!q -> nodes.empty()) {
+                if (prioritized) {
+                    std::pop_heap(q -> nodes.begin(), q -> nodes.end(), costlier);
+                    node = q -> nodes.back();
+                    q -> nodes.pop_back();
+                } else if (i == 0) {
+                    node = q -> nodes.front();
+                    q -> nodes.pop_front();
+                } else {
+                    node = q -> nodes.back();
+                    q -> nodes.pop_back();
+                }
+            }
+        pthread_mutex_unlock(&q -> mtx);
+
+        if (node != nullptr) return node;
+    }
+
+    return nullptr;
+}
+
+bool Scheduler::hasWork() {
+    for (WorkerQueue *q : queues) {
+        pthread_mutex_lock(&q -> mtx);
+            bool empty = q -> nodes.empty();
+        pthread_mutex_unlock(&q -> mtx);
+
+        if (!empty) return true;
+    }
+
+    return false;
+}
+
+ProofTreeNode *Scheduler::pop(size_t worker) {
+    while (true) {
+        ProofTreeNode *node = take(worker % queues.size());
+        if (node != nullptr) return node;
+
+        pthread_mutex_lock(&idle_mtx);
+            sleeping++;
+
+            // Recheck after announcing ourselves, so a push in between can't be missed
+            while (!stopped && (locked || !hasWork())) pthread_cond_wait(&has_work, &idle_mtx);
+
+            sleeping--;
+            bool stop = stopped;
+        pthread_mutex_unlock(&idle_mtx);
+
+        if (stop) return nullptr;
+    }
+}
+
+bool Scheduler::finish() {
+    // Not the last node, so no one is waiting on this
+    size_t count = pending.load();
+    while (count > 1) {
+        if (pending.compare_exchange_weak(count, count - 1)) return false;
+    }
+
+    // The last node is retired under the idle lock, so wait() can't return (and the next
+    // ask can't unlock) before we have read locked. Otherwise a stale nullptr could be pushed.
+    pthread_mutex_lock(&idle_mtx);
+        size_t left = --pending;
+        bool exhausted = left == 0 && !locked;
+
+        if (left == 0) pthread_cond_broadcast(&drained);
+    pthread_mutex_unlock(&idle_mtx);
+
+    return exhausted;
+}
+
+void Scheduler::wait() {
+    pthread_mutex_lock(&idle_mtx);
+        while (pending > 0) pthread_cond_wait(&drained, &idle_mtx);
+    pthread_mutex_unlock(&idle_mtx);
+}
+
+void Scheduler::setPrioritized(bool prioritized) {
+    this -> prioritized = prioritized;
+}
+
+void Scheduler::lock() {
+    locked = true;
+
+    size_t dropped = 0;
+
+    for (WorkerQueue *q : queues) {
+        pthread_mutex_lock(&q -> mtx);
+            dropped += q -> nodes.size();
+            q -> nodes.clear();
+        pthread_mutex_unlock(&q -> mtx);
+    }
+
+    // Nodes being processed still count, so wait() returns once they are finished
+    if (dropped > 0 && (pending -= dropped) == 0) {
+        pthread_mutex_lock(&idle_mtx);
+            pthread_cond_broadcast(&drained);
+        pthread_mutex_unlock(&idle_mtx);
+    }
+}
+
+void Scheduler::unlock() {
+    pthread_mutex_lock(&idle_mtx);
+        locked = false;
+        pthread_cond_broadcast(&has_work);
+    pthread_mutex_unlock(&idle_mtx);
+}
+
+void Scheduler::shutdown() {
+    pthread_mutex_lock(&idle_mtx);
+        stopped = true;
+        pthread_cond_broadcast(&has_work);
+    pthread_mutex_unlock(&idle_mtx);
+}
+
+size_t Scheduler::workers() const {
+    return queues.size();
+}
+
+NodeArena *Scheduler::arena(size_t worker) {
+    return arenas[worker % arenas.size()];
+}
+
+void Scheduler::resetArenas() {
+    for (NodeArena *a : arenas) {
+        a -> reset();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <pthread.h>
+#include <vector>
+
+#include "tree.h"
+
+using std::deque;
+using std::vector;
+
+/**
+ * @brief Work-stealing scheduler for proof tree nodes. Thread safe.
+ *
+ * Each worker has its own deque. A worker takes nodes from the front of its own deque
+ * (so a single worker searches breadth first), and when that is empty it steals from
+ * the back of the other workers' deques. Idle workers sleep until there is work.
+ *
+ * In prioritized mode every deque is kept as a min-heap on the node cost instead, and both
+ * the owner and thieves take the cheapest node. Together the heaps form a relaxed
+ * concurrent priority queue: each worker takes one of the cheapest nodes, not always the cheapest.
+ */
+class Scheduler {
+    public:
+    Scheduler(size_t workers);
+    ~Scheduler();
+
+    Scheduler(const Scheduler &other) = delete;
+    Scheduler &operator=(const Scheduler &other) = delete;
+
+    // Add a node to the given worker's deque. Nodes pushed while locked are dropped.
+    void push(size_t worker, ProofTreeNode *node);
+
+    /**
+     * @brief Get the next node for a worker, stealing from the other workers if needed.
+     * Blocks while there is no work or the scheduler is locked.
+     *
+     * @param worker The index of the calling worker.
+     * @return The node to process, or nullptr once the scheduler is shut down.
+     */
+    ProofTreeNode *pop(size_t worker);
+
+    /**
+     * @brief Mark a node returned by pop as processed. Its children must already be pushed.
+     *
+     * @return true if it was the last outstanding node, ie. the search is exhausted
+     * @return false otherwise (or if the scheduler is locked)
+     */
+    bool finish();
+
+    // Block until no nodes are queued or being processed.
+    void wait();
+
+    // Switch between FIFO deques and cost heaps. Only call this while no nodes are queued.
+    void setPrioritized(bool prioritized);
+
+    // Drop all queued nodes and hand out no work until unlock is called.
+    void lock();
+    void unlock();
+
+    // Wake all workers and make pop return nullptr.
+    void shutdown();
+
+    size_t workers() const;
+
+    // The node arena of the given worker. Only that worker may allocate from it while an ask runs.
+    NodeArena *arena(size_t worker);
+
+    // Free every node of the ask in O(1). Only call this once wait() has returned.
+    void resetArenas();
+
+    private:
+    struct WorkerQueue {
+        pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+        deque<ProofTreeNode*> nodes;
+    };
+
+    vector<WorkerQueue*> queues;
+    vector<NodeArena*> arenas;
+
+    // Nodes pushed but not finished yet (queued or being processed).
+    std::atomic<size_t> pending;
+    std::atomic<size_t> sleeping;
+
+    std::atomic<bool> locked;
+    std::atomic<bool> stopped;
+    std::atomic<bool> prioritized;
+
+    pthread_mutex_t idle_mtx = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t has_work = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t drained = PTHREAD_COND_INITIALIZER;
+
+    ProofTreeNode *take(size_t worker);
+    bool hasWork();
+};
\ No newline at end of file
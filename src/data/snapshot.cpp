@@ -0,0 +1,446 @@
+#include "globals.h"
+#include "rule.h"
+#include "snapshot.h"
+#include "symbols.h"
+#include "term.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using std::ios;
+using std::map;
+using std::ofstream;
+using std::pair;
+using std::set;
+using std::string;
+using std::string_view;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+using namespace rules;
+
+// The words of a snapshot being written. Names and terms are numbered the first time they are written.
+struct SnapshotWriter {
+    const Env *env;
+
+    map<string, uint32_t> name_ids;
+    vector<string> names;
+
+    unordered_map<TermId, uint32_t> term_ids;
+    vector<uint32_t> term_words;
+};
+
+static uint32_t writeName(SnapshotWriter &writer, const string &name) {
+    auto found = writer.name_ids.find(name);
+    if (found != writer.name_ids.end()) return found -> second;
+
+    uint32_t id = writer.names.size();
+    writer.name_ids[name] = id;
+    writer.names.push_back(name);
+    return id;
+}
+
+static void writeNames(SnapshotWriter &writer, vector<uint32_t> &words, const set<string> &names) {
+    words.push_back(names.size());
+    for (const string &name : names) {
+        words.push_back(writeName(writer, name));
+    }
+}
+
+static void writeTypedNames(SnapshotWriter &writer, vector<uint32_t> &words, const map<string, string> &names) {
+    words.push_back(names.size());
+    for (auto &name : names) {
+        words.push_back(writeName(writer, name.first));
+        words.push_back(writeName(writer, name.second));
+    }
+}
+
+// Write a term after its children, so a loader can intern the terms in file order.
+static uint32_t writeTerm(SnapshotWriter &writer, TermId id) {
+    auto found = writer.term_ids.find(id);
+    if (found != writer.term_ids.end()) return found -> second;
+
+    const Term &term = writer.env -> terms -> get(id);
+
+    vector<uint32_t> children = vector<uint32_t>();
+    for (TermId child : term.sub_terms) {
+        children.push_back(writeTerm(writer, child));
+    }
+
+    vector<uint32_t> &words = writer.term_words;
+    words.push_back(writeName(writer, writer.env -> symbols -> name(term.rule_type)));
+    words.push_back(writeName(writer, writer.env -> symbols -> name(term.rule_value)));
+    words.push_back(writeName(writer, writer.env -> symbols -> name(term.rule_op)));
+    words.push_back(children.size());
+    words.insert(words.end(), children.begin(), children.end());
+
+    uint32_t index = writer.term_ids.size();
+    writer.term_ids[id] = index;
+    return index;
+}
+
+size_t saveSnapshot(const Env *env, const string &path) {
+    SnapshotWriter writer = SnapshotWriter();
+    writer.env = env;
+
+    vector<uint32_t> declarations = vector<uint32_t>();
+    writeNames(writer, declarations, env -> type_names);
+    writeNames(writer, declarations, env -> type_vars);
+
+    declarations.push_back(env -> operators.size());
+    for (auto &op : env -> operators) {
+        declarations.push_back(writeName(writer, op.first));
+        declarations.push_back(op.second.size());
+
+        for (const string &type : op.second) {
+            declarations.push_back(writeName(writer, type));
+        }
+    }
+
+    writeTypedNames(writer, declarations, env -> variables);
+    writeTypedNames(writer, declarations, env -> literals);
+    writeNames(writer, declarations, env -> conjunctions);
+
+    vector<uint32_t> rules = vector<uint32_t>();
+    rules.push_back(env -> rule_terms.size());
+    for (TermId rule : env -> rule_terms) {
+        rules.push_back(writeTerm(writer, rule));
+    }
+
+    // Put the file together now that every name and term has its number.
+    vector<uint32_t> words = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, (uint32_t) writer.names.size()};
+    for (const string &name : writer.names) {
+        words.push_back(name.size());
+
+        size_t start = words.size();
+        words.resize(start + (name.size() + 3) / 4, 0);
+        name.copy((char*) &words[start], name.size());
+    }
+
+    words.insert(words.end(), declarations.begin(), declarations.end());
+    words.push_back(writer.term_ids.size());
+    words.insert(words.end(), writer.term_words.begin(), writer.term_words.end());
+    words.insert(words.end(), rules.begin(), rules.end());
+
+    ofstream f;
+    f.open(path, ios::binary | ios::trunc);
+
+    if (!f.is_open()) {
+        throw "FileNotFoundException: Could not open the snapshot file for writing.";
+    }
+
+    f.write((const char*) words.data(), words.size() * sizeof(uint32_t));
+
+    if (!f.good()) {
+        throw "FileNotFoundException: Could not write the snapshot file.";
+    }
+
+    return env -> rule_terms.size();
+}
+
+// Reads the words of a mapped snapshot in place, checking every read stays inside the file.
+struct SnapshotReader {
+    const uint32_t *pos;
+    const uint32_t *end;
+
+    vector<string_view> names;
+};
+
+static uint32_t readWord(SnapshotReader &reader) {
+    if (reader.pos == reader.end) {
+        throw "ParseException: Invalid snapshot file";
+    }
+
+    return *reader.pos++;
+}
+
+// Read the length of a list. Every item takes at least a word, so it can't be more than the words left.
+static uint32_t readCount(SnapshotReader &reader) {
+    uint32_t count = readWord(reader);
+
+    if (count > (size_t) (reader.end - reader.pos)) {
+        throw "ParseException: Invalid snapshot file";
+    }
+
+    return count;
+}
+
+// Read an index that must be below count.
+static uint32_t readIndex(SnapshotReader &reader, size_t count) {
+    uint32_t index = readWord(reader);
+
+    if (index >= count) {
+        throw "ParseException: Invalid snapshot file";
+    }
+
+    return index;
+}
+
+static string readName(SnapshotReader &reader) {
+    return string(reader.names[readIndex(reader, reader.names.size())]);
+}
+
+static vector<string> readNames(SnapshotReader &reader) {
+    vector<string> names = vector<string>(readCount(reader));
+    for (string &name : names) {
+        name = readName(reader);
+    }
+
+    return names;
+}
+
+static vector<pair<string, string>> readTypedNames(SnapshotReader &reader) {
+    vector<pair<string, string>> names = vector<pair<string, string>>(readCount(reader));
+    for (auto &name : names) {
+        name.first = readName(reader);
+        name.second = readName(reader);
+    }
+
+    return names;
+}
+
+// How the names a snapshot declares may be used by its terms, so each term can be checked like the parser would.
+struct SnapshotNames {
+    unordered_set<string_view> types;
+    unordered_set<string_view> type_vars;
+    unordered_map<string_view, const vector<string>*> operators;
+    unordered_set<string_view> values;
+
+    // Every name declared so far, so no name is declared twice.
+    unordered_set<string_view> declared;
+};
+
+static void declareName(SnapshotNames &names, const string &name) {
+    if (!names.declared.insert(name).second) {
+        throw "ParseException: Invalid snapshot file";
+    }
+}
+
+static void checkType(const SnapshotNames &names, const string &type) {
+    if (names.types.find(type) == names.types.end()) {
+        throw "ParseException: Invalid snapshot file";
+    }
+}
+
+// Check a term record uses its names the way they are declared: a value is a declared variable, literal
+// or number with no children, and anything else is a declared operator with one child per argument.
+static void checkTerm(const SnapshotNames &names, string_view type, string_view value, string_view op, uint32_t child_count) {
+    if (names.types.find(type) == names.types.end()) {
+        throw "ParseException: Invalid snapshot file";
+    }
+
+    if (op.empty()) {
+        bool declared = names.values.find(value) != names.values.end() || isInt(string(value)) || isFloat(string(value));
+        if (!declared || child_count != 0) throw "ParseException: Invalid snapshot file";
+        return;
+    }
+
+    auto found = names.operators.find(op);
+    if (!value.empty() || found == names.operators.end() || found -> second -> size() != (size_t) child_count + 1) {
+        throw "ParseException: Invalid snapshot file";
+    }
+
+    // A concrete result type is fixed by the operator. Only a TypeVar result can be narrowed.
+    const string &result = (*found -> second)[0];
+    if (names.type_vars.find(result) == names.type_vars.end() && result != type) {
+        throw "ParseException: Invalid snapshot file";
+    }
+}
+
+// Check a declared name is free in the env, like a declare statement would.
+static void checkFree(Env *env, const string &name) {
+    if (env -> isReservedName(name)) {
+        throw "IllegalArgumentException: This name is already taken";
+    }
+}
+
+static size_t loadWords(Env *env, SnapshotReader &reader) {
+    if (readWord(reader) != SNAPSHOT_MAGIC || readWord(reader) != SNAPSHOT_VERSION) {
+        throw "ParseException: Invalid snapshot file";
+    }
+
+    // The names stay in the mapping; only the ones that end up in the env are copied.
+    reader.names.resize(readCount(reader));
+    for (string_view &name : reader.names) {
+        uint32_t length = readWord(reader);
+
+        if ((size_t) (reader.end - reader.pos) < ((size_t) length + 3) / 4) {
+            throw "ParseException: Invalid snapshot file";
+        }
+
+        name = string_view((const char*) reader.pos, length);
+        reader.pos += ((size_t) length + 3) / 4;
+    }
+
+    vector<string> type_names = readNames(reader);
+    vector<string> type_vars = readNames(reader);
+
+    vector<pair<string, vector<string>>> operators = vector<pair<string, vector<string>>>(readCount(reader));
+    for (auto &op : operators) {
+        op.first = readName(reader);
+        op.second = readNames(reader);
+
+        if (op.second.empty()) {
+            throw "ParseException: Invalid snapshot file";
+        }
+    }
+
+    vector<pair<string, string>> variables = readTypedNames(reader);
+    vector<pair<string, string>> literals = readTypedNames(reader);
+    vector<string> conjunctions = readNames(reader);
+
+    // Check the declarations make sense on their own, like the declare statements that made them.
+    SnapshotNames names = SnapshotNames();
+    names.types.insert(default_types.begin(), default_types.end());
+    for (auto &op : default_operators) names.operators[op.first] = &op.second;
+
+    for (const string &name : type_names) {
+        declareName(names, name);
+        names.types.insert(name);
+    }
+
+    for (const string &name : type_vars) {
+        declareName(names, name);
+        names.types.insert(name);
+        names.type_vars.insert(name);
+    }
+
+    for (auto &op : operators) {
+        declareName(names, op.first);
+        for (const string &type : op.second) checkType(names, type);
+        names.operators[op.first] = &op.second;
+    }
+
+    for (auto *values : {&variables, &literals}) {
+        for (auto &value : *values) {
+            declareName(names, value.first);
+            checkType(names, value.second);
+            names.values.insert(value.first);
+        }
+    }
+
+    for (const string &op : conjunctions) {
+        auto found = names.operators.find(op);
+        if (found == names.operators.end() || found -> second -> size() < 3) {
+            throw "ParseException: Invalid snapshot file";
+        }
+
+        for (const string &type : *found -> second) {
+            if (type != "Bool") throw "ParseException: Invalid snapshot file";
+        }
+    }
+
+    // Check the terms before interning any, so a bad file leaves the env as it was.
+    vector<const uint32_t*> terms = vector<const uint32_t*>(readCount(reader));
+    for (size_t i = 0; i < terms.size(); i++) {
+        terms[i] = reader.pos;
+
+        for (size_t j = 0; j < 3; j++) readIndex(reader, reader.names.size());
+
+        uint32_t child_count = readCount(reader);
+        for (size_t j = 0; j < child_count; j++) readIndex(reader, i);
+
+        checkTerm(names, reader.names[terms[i][0]], reader.names[terms[i][1]], reader.names[terms[i][2]], child_count);
+    }
+
+    // Rules are always of type Bool, like a declare rule statement checks.
+    vector<uint32_t> rules = vector<uint32_t>(readCount(reader));
+    for (uint32_t &rule : rules) {
+        rule = readIndex(reader, terms.size());
+
+        if (reader.names[terms[rule][0]] != "Bool") {
+            throw "ParseException: Invalid snapshot file";
+        }
+    }
+
+    if (reader.pos != reader.end) {
+        throw "ParseException: Invalid snapshot file";
+    }
+
+    for (const string &name : type_names) checkFree(env, name);
+    for (const string &name : type_vars) checkFree(env, name);
+    for (auto &op : operators) checkFree(env, op.first);
+    for (auto &var : variables) checkFree(env, var.first);
+    for (auto &literal : literals) checkFree(env, literal.first);
+
+    // Declarations go first, so the names in the terms get their kinds.
+    env -> type_names.insert(type_names.begin(), type_names.end());
+    env -> type_vars.insert(type_vars.begin(), type_vars.end());
+    env -> operators.insert(operators.begin(), operators.end());
+    env -> variables.insert(variables.begin(), variables.end());
+    env -> literals.insert(literals.begin(), literals.end());
+
+    for (const string &op : conjunctions) {
+        env -> addConjunction(op);
+    }
+
+    // Children always come before their parents, so each term's children are already interned.
+    vector<TermId> ids = vector<TermId>(terms.size());
+    for (size_t i = 0; i < terms.size(); i++) {
+        const uint32_t *record = terms[i];
+
+        Term term;
+        term.rule_type = env -> symbol(string(reader.names[record[0]]));
+        term.rule_value = env -> symbol(string(reader.names[record[1]]));
+        term.rule_op = env -> symbol(string(reader.names[record[2]]));
+
+        for (size_t j = 0; j < record[3]; j++) {
+            term.sub_terms.push_back(ids[record[4 + j]]);
+        }
+
+        ids[i] = env -> terms -> make(term);
+    }
+
+    for (uint32_t rule : rules) {
+        env -> addRule(ids[rule]);
+    }
+
+    return rules.size();
+}
+
+size_t loadSnapshot(Env *env, const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd == -1) {
+        throw "FileNotFoundException: Please check the file exists.";
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size == 0 || info.st_size % sizeof(uint32_t) != 0) {
+        close(fd);
+        throw "ParseException: Invalid snapshot file";
+    }
+
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        throw "FileNotFoundException: Could not map the snapshot file.";
+    }
+
+    SnapshotReader reader = SnapshotReader();
+    reader.pos = (const uint32_t*) data;
+    reader.end = reader.pos + info.st_size / sizeof(uint32_t);
+
+    try {
+        size_t loaded = loadWords(env, reader);
+        munmap(data, info.st_size);
+        return loaded;
+    } catch (...) {
+        munmap(data, info.st_size);
+        throw;
+    }
+}
\ No newline at end of file
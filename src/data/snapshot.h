@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "rule.h"
+
+using std::string;
+
+// Marks a RiLab snapshot file ("RLSN"), followed by the format version.
+const uint32_t SNAPSHOT_MAGIC = 0x4e534c52;
+const uint32_t SNAPSHOT_VERSION = 1;
+
+/**
+ * @brief Write the env's declarations and rules to a binary snapshot file.
+ *
+ * The file is a flat array of native 32 bit words, so it can be mapped and checked in place:
+ * the magic and version, a table of every name used (each a length, then its bytes padded
+ * to a whole word), then the type names, TypeVars, operators, variables, literals and
+ * conjunctions as indices into the name table. Rules follow as their interned terms,
+ * children before parents, so loading them needs no parsing. Each term is still checked
+ * against the declarations (name kinds, arities and Bool rules) before any is interned,
+ * but the full type inference of a declare rule statement is skipped.
+ *
+ * @param env The env to save. Only the declarations and rules are saved, not the settings.
+ * @param path The file to write. It is overwritten if it exists.
+ * @return size_t The number of rules written.
+ * @throws FileNotFoundException when the file can't be written
+ */
+size_t saveSnapshot(const Env *env, const string &path);
+
+/**
+ * @brief Add the declarations and rules of a snapshot written by saveSnapshot to the env.
+ * Nothing is added unless the whole snapshot is valid and none of its names are taken.
+ *
+ * @param env The env to load into.
+ * @param path The snapshot file.
+ * @return size_t The number of rules loaded.
+ * @throws FileNotFoundException when the file can't be read
+ * @throws ParseException when the file isn't a valid snapshot
+ * @throws IllegalArgumentException when the snapshot declares a name the env already uses
+ */
+size_t loadSnapshot(Env *env, const string &path);
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include "sourceManager.h"
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+using std::hash;
+using std::string;
+using std::string_view;
+
+SourceManager::SourceManager(const SourceManager &other) {
+    graph = other.graph;
+    cache = other.cache;
+}
+
+SourceManager &SourceManager::operator=(const SourceManager &other) {
+    if (this != &other) {
+        sourcing.clear();
+        graph = other.graph;
+        cache = other.cache;
+    }
+
+    return *this;
+}
+
+void SourceManager::enter(const string &file) {
+    for (const string &open : sourcing) {
+        if (open == file) throw "IllegalArgumentException: Circular source commands are not allowed";
+    }
+
+    if (!sourcing.empty()) graph[sourcing.back()].insert(file);
+    sourcing.push_back(file);
+}
+
+void SourceManager::leave() {
+    sourcing.pop_back();
+}
+
+const set<string> &SourceManager::includes(const string &file) const {
+    static const set<string> none = set<string>();
+
+    auto found = graph.find(file);
+    return found == graph.end() ? none : found -> second;
+}
+
+bool SourceManager::loaded(string_view content) const {
+    auto range = cache.equal_range(hash<string_view>()(content));
+
+    for (auto it = range.first; it != range.second; it++) {
+        if (it -> second == content) return true;
+    }
+
+    return false;
+}
+
+void SourceManager::add(string_view content) {
+    cache.insert({hash<string_view>()(content), string(content)});
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using std::map;
+using std::set;
+using std::string;
+using std::string_view;
+using std::unordered_multimap;
+using std::vector;
+
+/**
+ * @brief Tracks the files an env sources: which file sources which, the files being
+ * sourced right now (to reject cycles), and the files of declarations already loaded, by their contents.
+ *
+ * Files are looked up by a hash of their contents, and a hit is only trusted once the contents
+ * are equal, so a collision can't replay the wrong file. An entry is only added once a file has loaded into the env, and the env never forgets a
+ * declaration or rule, so the cache never holds more than the env itself does.
+ * Not thread safe: only used while parsing.
+ */
+class SourceManager {
+    public:
+    SourceManager() = default;
+    SourceManager(const SourceManager &other);
+    SourceManager &operator=(const SourceManager &other);
+
+    /**
+     * @brief Start sourcing a file, from the file being sourced now (if any).
+     *
+     * @param file The canonical path of the file.
+     * @throws IllegalArgumentException when the file is already being sourced (a circular source)
+     */
+    void enter(const string &file);
+
+    // Finish sourcing the last file entered.
+    void leave();
+
+    // The files a file has sourced so far.
+    const set<string> &includes(const string &file) const;
+
+    // Check if a file of declarations with these contents already loaded into the env.
+    bool loaded(string_view content) const;
+
+    // Remember a file of declarations that loaded into the env.
+    void add(string_view content);
+
+    private:
+    vector<string> sourcing;
+    map<string, set<string>> graph;
+
+    // The contents of the files of declarations loaded so far, keyed by their hash.
+    unordered_multimap<size_t, string> cache;
+};
\ No newline at end of file
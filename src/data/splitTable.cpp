@@ -0,0 +1,73 @@
+#include <pthread.h>
+
+#include "splitTable.h"
+#include "tree.h"
+
+SplitTable::~SplitTable() {
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        pthread_mutex_destroy(&shards[i].mtx);
+    }
+}
+
+SplitTable::Shard &SplitTable::shardFor(ProofTreeNode *conjunction) {
+    // Nodes of an arena sit next to each other, so dividing by the node size numbers them
+    // one by one and conjunctions made in a row go to different shards
+    return shards[(reinterpret_cast<uintptr_t>(conjunction) / sizeof(ProofTreeNode)) % SHARD_COUNT];
+}
+
+void SplitTable::split(ProofTreeNode *conjunction, const vector<ProofTreeNode*> &conjuncts) {
+    Shard &shard = shardFor(conjunction);
+
+    pthread_mutex_lock(&shard.mtx);
+        Split &split = shard.splits[conjunction];
+        split.conjuncts = conjuncts;
+        split.leaves = vector<ProofTreeNode*>(conjuncts.size(), nullptr);
+        split.open = conjuncts.size();
+    pthread_mutex_unlock(&shard.mtx);
+}
+
+bool SplitTable::prove(ProofTreeNode *conjunction, ProofTreeNode *conjunct, ProofTreeNode *leaf, vector<ProofTreeNode*> &leaves) {
+    Shard &shard = shardFor(conjunction);
+    bool complete = false;
+
+    pthread_mutex_lock(&shard.mtx);
+        Split &split = shard.splits[conjunction];
+
+        for (size_t i = 0; i < split.conjuncts.size(); i++) {
+            if (split.conjuncts[i] != conjunct || split.leaves[i] != nullptr) continue;
+
+            split.leaves[i] = leaf;
+            split.open--;
+
+            if (split.open == 0) {
+                leaves = split.leaves;
+                complete = true;
+            }
+        }
+    pthread_mutex_unlock(&shard.mtx);
+
+    return complete;
+}
+
+bool SplitTable::proved(ProofTreeNode *conjunction, ProofTreeNode *conjunct) {
+    Shard &shard = shardFor(conjunction);
+    bool found = false;
+
+    pthread_mutex_lock(&shard.mtx);
+        auto split = shard.splits.find(conjunction);
+
+        if (split != shard.splits.end()) {
+            for (size_t i = 0; i < split -> second.conjuncts.size(); i++) {
+                if (split -> second.conjuncts[i] == conjunct) found = split -> second.leaves[i] != nullptr;
+            }
+        }
+    pthread_mutex_unlock(&shard.mtx);
+
+    return found;
+}
+
+void SplitTable::clear() {
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        shards[i].splits.clear();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+
+using std::unordered_map;
+using std::vector;
+
+struct ProofTreeNode;
+
+/**
+ * @brief Concurrent table of the conjunctions split by an ask, and the proofs found for their sides.
+ *
+ * A goal built with a conjunction operator is split into one conjunct per side, and every
+ * conjunct is searched on its own. The first proof of each conjunct is kept, and once all
+ * of them have one, the caller joins them into a proof of the conjunction.
+ */
+class SplitTable {
+    public:
+    SplitTable() = default;
+    ~SplitTable();
+
+    SplitTable(const SplitTable &other) = delete;
+    SplitTable &operator=(const SplitTable &other) = delete;
+
+    /**
+     * @brief Record a split. Call this before any of the conjuncts is searched.
+     *
+     * @param conjunction The node whose goal was split.
+     * @param conjuncts The roots of the conjuncts' searches, in the order of the sides.
+     */
+    void split(ProofTreeNode *conjunction, const vector<ProofTreeNode*> &conjuncts);
+
+    /**
+     * @brief Record a proof of a conjunct. Only the first proof of each conjunct is kept.
+     *
+     * @param conjunction The node whose goal was split.
+     * @param conjunct The root of the proven conjunct.
+     * @param leaf The leaf the conjunct's proof ends in.
+     * @param leaves Set to the proof of every conjunct, in order, if this was the last one missing.
+     * @return true if this proof completed the conjunction (this happens once per split)
+     * @return false otherwise
+     */
+    bool prove(ProofTreeNode *conjunction, ProofTreeNode *conjunct, ProofTreeNode *leaf, vector<ProofTreeNode*> &leaves);
+
+    // Check if a conjunct already has a proof, so the rest of its search can be dropped.
+    bool proved(ProofTreeNode *conjunction, ProofTreeNode *conjunct);
+
+    // Forget all splits. Not thread safe: only call this while no ask is running.
+    void clear();
+
+    private:
+    static const size_t SHARD_COUNT = 64;
+
+    struct Split {
+        vector<ProofTreeNode*> conjuncts;
+        vector<ProofTreeNode*> leaves;
+        size_t open = 0;
+    };
+
+    struct Shard {
+        pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+        unordered_map<ProofTreeNode*, Split> splits;
+    };
+
+    Shard shards[SHARD_COUNT];
+
+    Shard &shardFor(ProofTreeNode *conjunction);
+};
\ No newline at end of file
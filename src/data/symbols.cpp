@@ -0,0 +1,61 @@
+#include <string>
+#include <vector>
+
+#include "symbols.h"
+
+using std::string;
+using std::vector;
+
+SymbolTable::SymbolTable() {
+    symbols = vector<Symbol>();
+    ids = unordered_map<string, SymbolId>();
+
+    // Must match the ids in symbols.h
+    intern("");
+    intern("_");
+    intern("-->");
+    intern("--<>");
+    intern("Bool");
+
+    setKind(WILDCARD_SYMBOL, SYMBOL_TYPE);
+    setKind(IMPLIES_SYMBOL, SYMBOL_OPERATOR);
+    setKind(EQUIV_SYMBOL, SYMBOL_OPERATOR);
+    setKind(BOOL_SYMBOL, SYMBOL_TYPE);
+}
+
+SymbolId SymbolTable::intern(const string &name) {
+    auto found = ids.find(name);
+    if (found != ids.end()) return found -> second;
+
+    SymbolId id = symbols.size();
+
+    Symbol symbol;
+    symbol.name = name;
+    symbols.push_back(symbol);
+
+    ids[name] = id;
+    return id;
+}
+
+SymbolId SymbolTable::find(const string &name) const {
+    auto found = ids.find(name);
+    if (found != ids.end()) return found -> second;
+
+    return NO_SYMBOL;
+}
+
+const string &SymbolTable::name(SymbolId id) const {
+    return symbols[id].name;
+}
+
+SymbolKind SymbolTable::kind(SymbolId id) const {
+    return symbols[id].kind;
+}
+
+void SymbolTable::setKind(SymbolId id, SymbolKind kind) {
+    symbols[id].kind = kind;
+}
+
+size_t SymbolTable::size() const {
+    return symbols.size();
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// Compact handle for any name used in a rule (types, operators, variables, literals).
+typedef uint32_t SymbolId;
+
+// Well-known symbols. These are interned first, so their ids are fixed.
+const SymbolId NO_SYMBOL = 0;       // ""
+const SymbolId WILDCARD_SYMBOL = 1; // _
+const SymbolId IMPLIES_SYMBOL = 2;  // -->
+const SymbolId EQUIV_SYMBOL = 3;    // --<>
+const SymbolId BOOL_SYMBOL = 4;     // Bool
+
+enum SymbolKind {
+    SYMBOL_NONE,
+    SYMBOL_TYPE,
+    SYMBOL_TYPEVAR,
+    SYMBOL_OPERATOR,
+    SYMBOL_VARIABLE,
+    SYMBOL_LITERAL
+};
+
+struct Symbol {
+    string name;
+    SymbolKind kind = SYMBOL_NONE;
+};
+
+/**
+ * @brief Interning table mapping each name to a compact integer id with a kind tag.
+ *
+ * Lookups by id are safe from any thread. Interning new names is not thread safe,
+ * so it must only happen while no ask is running (ie, during parsing).
+ */
+class SymbolTable {
+    public:
+    SymbolTable();
+
+    /**
+     * @brief Get the id for a name, adding it if needed.
+     *
+     * @param name The name to intern.
+     * @return SymbolId The id for this name. New names start with kind SYMBOL_NONE.
+     */
+    SymbolId intern(const string &name);
+
+    // Get the id for a name without adding it. Returns NO_SYMBOL if the name is unknown.
+    SymbolId find(const string &name) const;
+
+    const string &name(SymbolId id) const;
+
+    SymbolKind kind(SymbolId id) const;
+    void setKind(SymbolId id, SymbolKind kind);
+
+    size_t size() const;
+
+    private:
+    vector<Symbol> symbols;
+    unordered_map<string, SymbolId> ids;
+};
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include <new>
+#include <pthread.h>
+#include <vector>
+
+#include "term.h"
+
+using std::vector;
+
+// Mix a value into a running hash (boost::hash_combine style).
+static size_t combineHash(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+static size_t hashTerm(const Term &term) {
+    size_t h = term.rule_type;
+    h = combineHash(h, term.rule_value);
+    h = combineHash(h, term.rule_op);
+
+    for (TermId child : term.sub_terms) {
+        h = combineHash(h, child);
+    }
+
+    return h;
+}
+
+static bool sameTerm(const Term &fst, const Term &snd) {
+    return fst.hash == snd.hash &&
+    fst.rule_type == snd.rule_type &&
+    fst.rule_value == snd.rule_value &&
+    fst.rule_op == snd.rule_op &&
+    fst.sub_terms == snd.sub_terms;
+}
+
+// Chunk c holds BASE_CHUNK_SIZE * 2^c terms, starting at BASE_CHUNK_SIZE * (2^c - 1).
+static size_t chunkOf(size_t id, size_t base) {
+    return 63 - __builtin_clzll(id / base + 1);
+}
+
+static size_t chunkStart(size_t chunk, size_t base) {
+    return base * ((1ULL << chunk) - 1);
+}
+
+TermStore::Space::Space() {
+    for (size_t i = 0; i < MAX_CHUNKS; i++) chunks[i] = nullptr;
+    count = 0;
+}
+
+Term *TermStore::Space::slot(size_t index) const {
+    size_t chunk = chunkOf(index, BASE_CHUNK_SIZE);
+    Term *start = chunks[chunk].load(std::memory_order_acquire);
+
+    return start + (index - chunkStart(chunk, BASE_CHUNK_SIZE));
+}
+
+Term *TermStore::Space::allocate(size_t index) {
+    size_t chunk = chunkOf(index, BASE_CHUNK_SIZE);
+
+    if (chunk >= MAX_CHUNKS) throw "OutOfMemoryError: Too many terms";
+
+    // Allocate the chunk on first use. Only one thread wins the race.
+    if (chunks[chunk].load(std::memory_order_acquire) == nullptr) {
+        size_t chunk_size = BASE_CHUNK_SIZE << chunk;
+        Term *fresh = static_cast<Term*>(::operator new(sizeof(Term) * chunk_size));
+
+        Term *expected = nullptr;
+        if (!chunks[chunk].compare_exchange_strong(expected, fresh, std::memory_order_acq_rel)) {
+            ::operator delete(fresh);
+        }
+    }
+
+    return slot(index);
+}
+
+void TermStore::Space::release() {
+    size_t total = count;
+
+    for (size_t i = 0; i < total; i++) {
+        slot(i) -> ~Term();
+    }
+
+    for (size_t i = 0; i < MAX_CHUNKS; i++) {
+        ::operator delete(chunks[i].load());
+        chunks[i] = nullptr;
+    }
+
+    count = 0;
+}
+
+TermStore::TermStore() : scratch_open(false) {}
+
+TermStore::~TermStore() {
+    permanent.release();
+    scratch.release();
+
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        pthread_mutex_destroy(&shards[i].mtx);
+    }
+}
+
+TermId TermStore::intern(Term term, bool to_scratch) {
+    term.hash = hashTerm(term);
+
+    Shard &shard = shards[term.hash % SHARD_COUNT];
+
+    pthread_mutex_lock(&shard.mtx);
+        // A term made before the scratch space was opened is never copied into it
+        auto range = shard.index.equal_range(term.hash);
+
+        for (auto i = range.first; i != range.second; ++i) {
+            if (sameTerm(get(i -> second), term)) {
+                TermId existing = i -> second;
+                pthread_mutex_unlock(&shard.mtx);
+                return existing;
+            }
+        }
+
+        if (to_scratch) {
+            range = shard.scratch_index.equal_range(term.hash);
+
+            for (auto i = range.first; i != range.second; ++i) {
+                if (sameTerm(get(i -> second), term)) {
+                    TermId existing = i -> second;
+                    pthread_mutex_unlock(&shard.mtx);
+                    return existing;
+                }
+            }
+        }
+
+        Space &space = to_scratch ? scratch : permanent;
+
+        size_t index = space.count.fetch_add(1);
+        if (index >= SCRATCH_TERM - 1) {
+            pthread_mutex_unlock(&shard.mtx);
+            throw "OutOfMemoryError: Too many terms";
+        }
+
+        Term *target = space.allocate(index);
+        new (target) Term(std::move(term));
+
+        TermId id = to_scratch ? (TermId) index | SCRATCH_TERM : (TermId) index;
+
+        if (to_scratch) shard.scratch_index.insert({target -> hash, id});
+        else shard.index.insert({target -> hash, id});
+    pthread_mutex_unlock(&shard.mtx);
+
+    return id;
+}
+
+TermId TermStore::make(Term term) {
+    return intern(std::move(term), scratch_open.load(std::memory_order_relaxed));
+}
+
+const Term &TermStore::get(TermId id) const {
+    if (isScratch(id)) return *scratch.slot(id & ~SCRATCH_TERM);
+    return *permanent.slot(id);
+}
+
+size_t TermStore::size() const {
+    return permanent.count;
+}
+
+size_t TermStore::scratchSize() const {
+    return scratch.count;
+}
+
+TermId TermStore::copy(const TermStore &from, TermId id) {
+    Term term = from.get(id);
+
+    for (TermId &child : term.sub_terms) {
+        child = copy(from, child);
+    }
+
+    return make(term);
+}
+
+void TermStore::openScratch() {
+    scratch_open = true;
+}
+
+TermId TermStore::keep(TermId id) {
+    if (!isScratch(id)) return id;
+
+    Term term = get(id);
+
+    for (TermId &child : term.sub_terms) {
+        child = keep(child);
+    }
+
+    return intern(term, false);
+}
+
+void TermStore::dropScratch() {
+    scratch_open = false;
+
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        shards[i].scratch_index.clear();
+    }
+
+    scratch.release();
+}
+
+bool TermStore::isScratch(TermId id) {
+    return id != NO_TERM && (id & SCRATCH_TERM) != 0;
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+
+#include "symbols.h"
+
+using std::unordered_multimap;
+using std::vector;
+
+// Handle for a hash-consed term. Two structurally equal terms always share the same id.
+typedef uint32_t TermId;
+
+const TermId NO_TERM = UINT32_MAX;
+
+// Set on the ids of terms in a store's scratch space (see TermStore::openScratch).
+const TermId SCRATCH_TERM = 1u << 31;
+
+// A single node in the term DAG. Terms are immutable once interned, so they can be shared freely.
+// Names are symbol ids in the owning Env's SymbolTable (NO_SYMBOL for an empty field).
+struct Term {
+    SymbolId rule_type = NO_SYMBOL;
+    SymbolId rule_value = NO_SYMBOL;
+    SymbolId rule_op = NO_SYMBOL;
+
+    vector<TermId> sub_terms;
+
+    size_t hash = 0;
+};
+
+/**
+ * @brief Hash-consed term storage. Each distinct subterm is stored exactly once,
+ * so equality is an id compare and copying a term is copying its id.
+ *
+ * Terms only hold ids; Env converts between terms and RuleTrees. Interning is thread
+ * safe. Terms are never moved once created, so references returned by get() stay
+ * valid for the lifetime of the store, or of the scratch space they were made in.
+ *
+ * An ask makes many goals that are dead once it ends. While the scratch space is open,
+ * new terms go there instead (with SCRATCH_TERM set in their id), and dropping it frees
+ * them all at once. A term is never in both spaces unless keep() copied it out.
+ */
+class TermStore {
+    public:
+    TermStore();
+    ~TermStore();
+
+    TermStore(const TermStore &other) = delete;
+    TermStore &operator=(const TermStore &other) = delete;
+
+    /**
+     * @brief Intern a single node whose children are already interned.
+     *
+     * @param term The node to intern. The hash is computed here.
+     * @return TermId The id of the (possibly pre-existing) term.
+     */
+    TermId make(Term term);
+
+    // Get the node for an id. The id must come from this store.
+    const Term &get(TermId id) const;
+
+    // The number of distinct terms interned outside the scratch space.
+    size_t size() const;
+
+    // The number of terms in the scratch space.
+    size_t scratchSize() const;
+
+    /**
+     * @brief Intern a term of another store, with its subterms, into this one.
+     * @return TermId The id of the copy in this store.
+     */
+    TermId copy(const TermStore &from, TermId id);
+
+    /**
+     * @brief Send the terms interned from now on to the scratch space, unless they already exist outside it.
+     * Not thread safe: only call this while no ask is running.
+     */
+    void openScratch();
+
+    /**
+     * @brief Copy a scratch term (and its subterms) out of the scratch space, so it survives dropScratch.
+     * Terms outside the scratch space are returned as they are.
+     * @return TermId The id of the term outside the scratch space.
+     */
+    TermId keep(TermId id);
+
+    /**
+     * @brief Free every term in the scratch space, and send new terms to the rest of the store again.
+     * Ids of scratch terms must not be used afterwards. Not thread safe: only call this while no ask is running.
+     */
+    void dropScratch();
+
+    static bool isScratch(TermId id);
+
+    private:
+    // Storage is split into chunks of doubling size, so growing never moves a term.
+    static const size_t BASE_CHUNK_SIZE = 64;
+    static const size_t MAX_CHUNKS = 32;
+
+    static const size_t SHARD_COUNT = 64;
+
+    struct Shard {
+        pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+        unordered_multimap<size_t, TermId> index;
+        unordered_multimap<size_t, TermId> scratch_index;
+    };
+
+    // Growable storage for one space. Slots are numbered from 0 in each.
+    struct Space {
+        std::atomic<Term*> chunks[MAX_CHUNKS];
+        std::atomic<size_t> count;
+
+        Space();
+
+        Term *slot(size_t index) const;
+        Term *allocate(size_t index);
+
+        // Destroy every term and free the chunks.
+        void release();
+    };
+
+    Space permanent;
+    Space scratch;
+    std::atomic<bool> scratch_open;
+
+    Shard shards[SHARD_COUNT];
+
+    // Find or add a term. New terms go to the scratch space if to_scratch is set.
+    TermId intern(Term term, bool to_scratch);
+};
\ No newline at end of file
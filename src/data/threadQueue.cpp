@@ -1,61 +1,186 @@
-#include <iostream>
-#include <pthread.h>
-#include <utility>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "threadQueue.h"
 #include "tree.h"
 
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32 bit ints");
+
+static void futexWait(std::atomic<uint32_t> *word, uint32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futexWake(std::atomic<uint32_t> *word, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// Register as a sleeper before the final check, so a concurrent wake() can't be missed:
+// either the check sees the new item, or the waker sees us and bumps seq.
+uint32_t ThreadQueue::Parking::prepare() {
+    waiters++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return seq.load();
+}
+
+void ThreadQueue::Parking::wait(uint32_t seen) {
+    futexWait(&seq, seen);
+    waiters--;
+}
+
+void ThreadQueue::Parking::cancel() {
+    waiters--;
+}
+
+void ThreadQueue::Parking::wake(bool all) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load() == 0) return;
+
+    seq++;
+    futexWake(&seq, all ? INT_MAX : 1);
+}
+
+ThreadQueue::ThreadQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    cells = new Cell[size];
+    mask = size - 1;
+
+    for (size_t i = 0; i < size; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+        cells[i].node = nullptr;
+    }
+
+    enqueue_pos = 0;
+    dequeue_pos = 0;
+
+    not_empty.seq = 0;
+    not_empty.waiters = 0;
+    not_full.seq = 0;
+    not_full.waiters = 0;
+
+    locked = false;
+}
+
 ThreadQueue::~ThreadQueue() {
-    pthread_mutex_destroy(&mtx);
-    pthread_cond_destroy(&q_empty);
+    delete[] cells;
+}
+
+bool ThreadQueue::tryPush(ProofTreeNode *node) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    Cell *cell;
+
+    while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell -> sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+        // The cell is free for this position, so try to claim it
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+
+        // The cell still holds an item from the previous lap, so the queue is full
+        else if (diff < 0) return false;
+
+        else pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+
+    cell -> node = node;
+    cell -> sequence.store(pos + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool ThreadQueue::tryPop(ProofTreeNode *&node) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    Cell *cell;
+
+    while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell -> sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+        // The cell holds the item for this position, so try to claim it
+        if (diff == 0) {
+            if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+
+        // Nothing has been written here yet, so the queue is empty
+        else if (diff < 0) return false;
+
+        else pos = dequeue_pos.load(std::memory_order_relaxed);
+    }
+
+    node = cell -> node;
+
+    // Free the cell for the push one lap later
+    cell -> sequence.store(pos + mask + 1, std::memory_order_release);
+
+    return true;
 }
 
 void ThreadQueue::push(ProofTreeNode *node) {
-    pthread_mutex_lock(&mtx);
-        q.push(node);
-        size++;
+    while (!tryPush(node)) {
+        uint32_t seen = not_full.prepare();
+
+        if (tryPush(node)) {
+            not_full.cancel();
+            break;
+        }
+
+        not_full.wait(seen);
+    }
 
-        pthread_cond_broadcast(&q_empty);
-    pthread_mutex_unlock(&mtx);
+    not_empty.wake(false);
 }
 
 ProofTreeNode *ThreadQueue::pop() {
-    pthread_mutex_lock(&mtx);
-        while (size == 0 && !locked) pthread_cond_wait(&q_empty, &mtx);
+    ProofTreeNode *node;
+
+    while (true) {
+        if (locked) return nullptr;
+        if (tryPop(node)) break;
+
+        uint32_t seen = not_empty.prepare();
+
         if (locked) {
-            pthread_mutex_unlock(&mtx);
+            not_empty.cancel();
             return nullptr;
         }
 
-        ProofTreeNode *front = q.front();
-        q.pop();
-
-        size--;
+        if (tryPop(node)) {
+            not_empty.cancel();
+            break;
+        }
 
-    pthread_mutex_unlock(&mtx);    
+        not_empty.wait(seen);
+    }
 
-    return front;
+    not_full.wake(false);
+    return node;
 }
 
 void ThreadQueue::lock() {
     clear();
-    pthread_mutex_lock(&mtx);
-        locked = true;
-        pthread_cond_broadcast(&q_empty);
-    pthread_mutex_unlock(&mtx);
+
+    locked = true;
+    not_empty.wake(true);
 }
 
 void ThreadQueue::unlock() {
-    pthread_mutex_lock(&mtx);
-        locked = false;
-    pthread_mutex_unlock(&mtx);
+    locked = false;
 }
 
 void ThreadQueue::clear() {
-    pthread_mutex_lock(&mtx);
-        queue<ProofTreeNode*> newq = queue<ProofTreeNode*>();
-        std::swap(q, newq);
+    ProofTreeNode *node;
+    bool removed = false;
+
+    while (tryPop(node)) removed = true;
 
-        size = 0;
-    pthread_mutex_unlock(&mtx);    
+    if (removed) not_full.wake(true);
 }
\ No newline at end of file
@@ -1,33 +1,71 @@
 #pragma once
 
-#include <pthread.h>
-#include <queue>
+#include <atomic>
+#include <cstdint>
 
 #include "tree.h"
 
-using std::queue;
-
-// Producer-Consumer Queue with no max size. Thread safe.
+/**
+ * @brief Lock-free multi-producer multi-consumer queue. Thread safe.
+ *
+ * A bounded ring buffer where every cell has a sequence number (Vyukov's MPMC queue),
+ * so push and pop are a single CAS each in the common case. A pop on an empty queue
+ * (or a push on a full one) parks the thread on a futex instead of spinning,
+ * and a push only makes a syscall if some thread is actually parked.
+ *
+ * This only carries results from the workers to the ask (at most a few per ask), so it is
+ * not on the search's hot path: the proof tree nodes themselves go through the Scheduler's mutex deques.
+ */
 class ThreadQueue {
     public:
-    ThreadQueue() = default;
+    // The capacity is rounded up to a power of two.
+    ThreadQueue(size_t capacity = 1 << 16);
     ~ThreadQueue();
 
+    ThreadQueue(const ThreadQueue &other) = delete;
+    ThreadQueue &operator=(const ThreadQueue &other) = delete;
+
+    // Add a node, waiting for space if the queue is full.
     void push(ProofTreeNode *node);
+
+    // Remove the oldest node, waiting until there is one. Returns nullptr while locked.
     ProofTreeNode *pop();
 
     void clear();
 
+    // Clear the queue and make pop return nullptr (waking up all waiting threads).
     void lock();
     void unlock();
 
     private:
-    queue<ProofTreeNode*> q = queue<ProofTreeNode*>();
+    struct Cell {
+        std::atomic<size_t> sequence;
+        ProofTreeNode *node;
+    };
+
+    // A futex word, plus a count of sleepers so wakers can skip the syscall.
+    struct Parking {
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> waiters;
+
+        uint32_t prepare();
+        void wait(uint32_t seen);
+        void cancel();
+        void wake(bool all);
+    };
+
+    Cell *cells;
+    size_t mask;
+
+    // Kept on separate cache lines so producers and consumers don't contend.
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
 
-    size_t size = 0;
+    alignas(64) Parking not_empty;
+    Parking not_full;
 
-    pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-    pthread_cond_t q_empty = PTHREAD_COND_INITIALIZER;
+    std::atomic<bool> locked;
 
-    bool locked = false;
+    bool tryPush(ProofTreeNode *node);
+    bool tryPop(ProofTreeNode *&node);
 };
\ No newline at end of file
@@ -1,11 +1,44 @@
+#include <vector>
+
 #include "tree.h"
 #include "rule.h"
 
-ProofTreeNode::~ProofTreeNode() {
-    for (ProofTreeNode *child : children) {
-        delete child;
+using std::vector;
+
+NodeArena::~NodeArena() {
+    for (ProofTreeNode *b : blocks) {
+        delete[] b;
     }
+}
+
+ProofTreeNode *NodeArena::make() {
+    if (used == BLOCK_SIZE) {
+        block++;
+        used = 0;
+    }
+
+    if (block == blocks.size()) blocks.push_back(new ProofTreeNode[BLOCK_SIZE]);
+
+    ProofTreeNode *node = blocks[block] + used;
+    used++;
+
+    // Blocks are reused after a reset, so clear any old contents
+    *node = ProofTreeNode();
+    return node;
+}
+
+void NodeArena::reset() {
+    block = 0;
+    used = 0;
+}
+
+size_t NodeArena::size() const {
+    return block * BLOCK_SIZE + used;
+}
+
+void NodeArena::rollback(size_t mark) {
+    if (mark >= size()) return;
 
-    delete applied_rule;
-    delete to_prove_remainder;
+    block = mark / BLOCK_SIZE;
+    used = mark % BLOCK_SIZE;
 }
\ No newline at end of file
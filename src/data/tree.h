@@ -2,20 +2,73 @@
 
 #include <map>
 #include <set>
+#include <vector>
 
 #include "rule.h"
+#include "term.h"
 
 using std::map;
 using std::vector;
 
 struct ProofTreeNode {
-    RuleTree *applied_rule = nullptr;
+    // Both terms are ids in the env's TermStore, so nodes share them instead of owning copies.
+    // to_prove_remainder is the goal left after applying applied_rule to the parent's goal.
+    TermId applied_rule = NO_TERM;
 
-    RuleTree *to_prove_remainder = nullptr;
+    TermId to_prove_remainder = NO_TERM;
 
-    set<ProofTreeNode*> children = set<ProofTreeNode*>();
+    // Number of rules applied between the ask and this node.
+    size_t depth = 0;
+
+    // True for nodes of the forward half of a bidirectional search. Their to_prove_remainder
+    // is a fact derived from the parent's fact by applied_rule, rather than a goal.
+    bool forward = false;
+
+    // Priority in best first mode. Lower costs are expanded first.
+    double cost = 0;
+
+    // Set inside the search of one side of a split conjunction, to the root of that search
+    // (which points to itself). Its parent is the node whose goal was split.
+    ProofTreeNode *conjunct = nullptr;
+
+    // Children form an intrusive list, so a node owns no heap memory of its own.
+    ProofTreeNode *first_child = nullptr;
+    ProofTreeNode *next_sibling = nullptr;
     ProofTreeNode *parent = nullptr;
+};
+
+/**
+ * @brief Bump allocator for proof tree nodes. Not thread safe: use one per worker.
+ *
+ * Nodes are never freed one by one. reset() forgets every node in O(1) and keeps
+ * the blocks for the next ask, so a warmed up search does not call malloc for nodes.
+ */
+class NodeArena {
+    public:
+    NodeArena() = default;
+    ~NodeArena();
+
+    NodeArena(const NodeArena &other) = delete;
+    NodeArena &operator=(const NodeArena &other) = delete;
+
+    // Get a fresh, default initialized node. It stays valid until reset().
+    ProofTreeNode *make();
+
+    // Invalidate all nodes made so far.
+    void reset();
+
+    // The number of nodes made since the last reset.
+    size_t size() const;
+
+    // Free every node made after size() returned mark, keeping the older ones (stack order).
+    void rollback(size_t mark);
+
+    private:
+    static const size_t BLOCK_SIZE = 4096;
+
+    vector<ProofTreeNode*> blocks;
 
-    ProofTreeNode() = default;
-    ~ProofTreeNode();
+    // Index of the block being filled, and the number of nodes used in it.
+    size_t block = 0;
+    size_t used = 0;
 };
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using std::unordered_map;
+using std::vector;
+
+const size_t NO_TYPE_VAR = SIZE_MAX;
+
+/**
+ * @brief Union-find over type variables, for inferring the types in a rule.
+ *
+ * Types are flat names (no type contains another), so each class of unified variables
+ * is either free or bound to a single concrete type. A variable can then only occur in a
+ * type through a chain of other variables (T = U, U = T), and unify merges such a cycle into
+ * one class instead of failing, so no separate occurs check is needed.
+ * Unions are by size with path compression, so a rule is checked in (almost) linear time.
+ *
+ * Name is how type names are stored: string while parsing, or SymbolId for interned terms
+ * (match binds the TypeVars of a rule this way).
+ * Not thread safe: use one unifier per rule being checked or matched.
+ */
+template <typename Name>
+class TypeUnifier {
+    public:
+    // Get the variable for a TypeVar name, adding it (free) if needed.
+    size_t variable(const Name &name) {
+        auto found = ids.find(name);
+        if (found != ids.end()) return found -> second;
+
+        size_t id = names.size();
+        ids[name] = id;
+        names.push_back(name);
+        parents.push_back(id);
+        sizes.push_back(1);
+        bindings.push_back(Name());
+        bound.push_back(false);
+        return id;
+    }
+
+    // The TypeVar name of a variable.
+    const Name &name(size_t var) const {
+        return names[var];
+    }
+
+    // The number of variables added so far.
+    size_t size() const {
+        return names.size();
+    }
+
+    // Get the representative of a variable's class.
+    size_t find(size_t var) {
+        size_t root = var;
+        while (parents[root] != root) root = parents[root];
+
+        // Point everything on the way straight at the root.
+        while (parents[var] != root) {
+            size_t next = parents[var];
+            parents[var] = root;
+            var = next;
+        }
+
+        return root;
+    }
+
+    /**
+     * @brief Bind a variable's class to a concrete type.
+     * @return false if the class is already bound to a different type
+     */
+    bool bind(size_t var, const Name &type) {
+        size_t root = find(var);
+
+        if (bound[root]) return bindings[root] == type;
+
+        bindings[root] = type;
+        bound[root] = true;
+        return true;
+    }
+
+    /**
+     * @brief Unify two variables, so they always have the same type.
+     * @return false if their classes are bound to different types
+     */
+    bool unify(size_t a, size_t b) {
+        a = find(a);
+        b = find(b);
+
+        if (a == b) return true;
+        if (bound[a] && bound[b] && !(bindings[a] == bindings[b])) return false;
+
+        if (sizes[a] < sizes[b]) {
+            size_t temp = a;
+            a = b;
+            b = temp;
+        }
+
+        parents[b] = a;
+        sizes[a] += sizes[b];
+
+        if (!bound[a] && bound[b]) {
+            bindings[a] = bindings[b];
+            bound[a] = true;
+        }
+
+        return true;
+    }
+
+    // Get the concrete type of a variable's class, or nullptr if it is still free.
+    const Name *binding(size_t var) {
+        size_t root = find(var);
+        return bound[root] ? &bindings[root] : nullptr;
+    }
+
+    // Get the concrete type a TypeVar name is bound to, or nullptr if it is free or was never added.
+    // Paths aren't compressed, so this also works on a const unifier.
+    const Name *lookup(const Name &name) const {
+        auto found = ids.find(name);
+        if (found == ids.end()) return nullptr;
+
+        size_t root = found -> second;
+        while (parents[root] != root) root = parents[root];
+
+        return bound[root] ? &bindings[root] : nullptr;
+    }
+
+    private:
+    unordered_map<Name, size_t> ids;
+    vector<Name> names;
+
+    vector<size_t> parents;
+    vector<size_t> sizes;
+
+    vector<Name> bindings;
+    vector<bool> bound;
+};
\ No newline at end of file
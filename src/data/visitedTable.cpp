@@ -0,0 +1,14 @@
+#include "term.h"
+#include "visitedTable.h"
+
+bool VisitedTable::visit(TermId goal, size_t depth) {
+    return depths.record(goal, depth);
+}
+
+void VisitedTable::clear() {
+    depths.clear();
+}
+
+size_t VisitedTable::size() {
+    return depths.size();
+}
\ No newline at end of file
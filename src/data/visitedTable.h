@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+#include "depthMap.h"
+#include "term.h"
+
+using std::less;
+
+/**
+ * @brief Concurrent table of the goals already reached during an ask, shared by all workers.
+ *
+ * Goals are hash-consed, so the TermId is already a canonical key: two structurally
+ * equal goals always have the same id. For each goal, the shallowest depth it was
+ * reached at is kept, so a goal reached again at the same or a deeper level can be dropped.
+ */
+class VisitedTable {
+    public:
+    VisitedTable() = default;
+
+    VisitedTable(const VisitedTable &other) = delete;
+    VisitedTable &operator=(const VisitedTable &other) = delete;
+
+    /**
+     * @brief Record that a goal was reached at the given depth.
+     *
+     * @param goal The goal to record.
+     * @param depth The depth of the proof tree node with this goal.
+     * @return true if the goal is new (or is now reached at a shallower depth), and should be expanded
+     * @return false if the goal was already reached at this depth or above
+     */
+    bool visit(TermId goal, size_t depth);
+
+    // Forget all goals. Not thread safe: only call this while no ask is running.
+    void clear();
+
+    // The number of distinct goals recorded.
+    size_t size();
+
+    private:
+    // The shallowest depth each goal was reached at.
+    DepthMap<less<size_t>> depths;
+};
\ No newline at end of file
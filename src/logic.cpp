@@ -1,13 +1,19 @@
+#include <algorithm>
 #include <iostream>
 #include <pthread.h>
 #include <queue>
-#include <signal.h>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "data/factStore.h"
+#include "data/frontier.h"
+#include "data/scheduler.h"
 #include "data/threadQueue.h"
 #include "data/rule.h"
+#include "data/symbols.h"
+#include "data/term.h"
 #include "data/tree.h"
 #include "logic.h"
 
@@ -15,104 +21,719 @@ using std::endl;
 using std::ostringstream;
 using std::queue;
 using std::string;
+using std::unordered_map;
 using std::vector;
 
-bool stop_ask = false;
+// In iddfs mode, nodes above this depth are expanded through the scheduler so every
+// worker gets a subtree. Deeper nodes are searched depth first by a single worker.
+static const size_t IDDFS_SPLIT_DEPTH = 2;
 
-string runAsk(Env *env, ThreadQueue *tasks, ThreadQueue *results) {
+// Check if the goal is equal (up to varsubs) to an existing rule.
+static bool matchesRule(Env *env, TermId goal) {
+    for (TermId rule : env -> rule_index -> matchingRules(goal)) {
+        MatchContext context;
+        MatchStatus status = match(env, rule, goal, context);
+
+        if (env -> cancel -> cancelled()) throw "Cancelled: The ask was stopped";
+        if (status == MATCH_OK) return true;
+    }
+
+    return false;
+}
+
+// Remove the children whose goal was already reached at the same depth or above,
+// possibly by another worker. Expanding them again can only find the same proofs, later.
+// The dropped nodes stay in the arena until the ask ends.
+static void dropVisited(Env *env, ProofTreeNode *node) {
+    ProofTreeNode **link = &node -> first_child;
+
+    while (*link != nullptr) {
+        ProofTreeNode *child = *link;
+
+        if (env -> visited -> visit(child -> to_prove_remainder, child -> depth)) link = &child -> next_sibling;
+        else *link = child -> next_sibling;
+    }
+}
+
+// How deep a node may be expanded. The two halves of a bidirectional search get half the limit each
+// (the backward half gets the odd step), so neither searches steps the other would cover.
+static size_t depthLimit(Env *env, const ProofTreeNode *node, size_t recursion_limit) {
+    if (env -> ask_search != SEARCH_BIDIRECTIONAL) return recursion_limit;
+    return node -> forward ? recursion_limit / 2 : recursion_limit - recursion_limit / 2;
+}
+
+// Check if the forward node's fact proves the backward node's goal, and claim the meeting if so.
+// The stitched proof has the length of both halves together, so it must fit in the limit.
+static bool meets(Env *env, ProofTreeNode *backward, ProofTreeNode *forward, size_t recursion_limit) {
+    if (backward -> depth + forward -> depth > recursion_limit) return false;
+
+    MatchContext context;
+    if (match(env, forward -> to_prove_remainder, backward -> to_prove_remainder, context) != MATCH_OK) return false;
+
+    return env -> meetings -> meet(backward, forward);
+}
+
+// Record a backward node in the meeting table, and check it against the facts derived so far.
+static bool meetsForward(Env *env, ProofTreeNode *backward, size_t recursion_limit) {
+    vector<ProofTreeNode*> partners;
+    env -> meetings -> addBackward(backward -> to_prove_remainder, backward, partners);
+
+    for (ProofTreeNode *forward : partners) {
+        if (env -> cancel -> cancelled()) throw "Cancelled: The ask was stopped";
+        if (meets(env, backward, forward, recursion_limit)) return true;
+    }
+
+    return false;
+}
+
+// Hand a proof to runAsk, and stop the other workers. The proof is pushed first,
+// so it is in the queue before anyone can see the ask is over.
+static void found(Env *env, ThreadQueue *results, ProofTreeNode *leaf) {
+    results -> push(leaf);
+    env -> cancel -> cancel(CANCEL_FOUND);
+}
+
+// Check if the goal is built with a declared conjunction operator.
+static bool isConjunction(Env *env, TermId goal) {
+    if (env -> conjunctions.empty()) return false;
+
+    const Term &term = env -> terms -> get(goal);
+    if (term.rule_op == NO_SYMBOL) return false;
+
+    return env -> conjunctions.find(env -> symbols -> name(term.rule_op)) != env -> conjunctions.end();
+}
+
+// Check if the node is the split goal right above the (copied) root of its first conjunct.
+static bool joins(Env *env, ProofTreeNode *node, ProofTreeNode *conjunct) {
+    if (!isConjunction(env, node -> to_prove_remainder)) return false;
+    return env -> terms -> get(node -> to_prove_remainder).sub_terms[0] == conjunct -> to_prove_remainder;
+}
+
+// Join the proofs of every conjunct of a split goal into one proof, and return its leaf.
+// Proofs are read from the leaf up, so the conjuncts' proofs are copied one above the other,
+// each up to its conjunct root (which has no rule), with the first conjunct right below the split goal.
+static ProofTreeNode *joinProofs(ProofTreeNode *conjunction, const vector<ProofTreeNode*> &leaves, NodeArena *arena) {
+    ProofTreeNode *above = conjunction;
+
+    for (ProofTreeNode *leaf : leaves) {
+        vector<ProofTreeNode*> path = {leaf};
+        while (path.back() -> parent != conjunction) path.push_back(path.back() -> parent);
+
+        for (auto step = path.rbegin(); step != path.rend(); step++) {
+            ProofTreeNode *copy = arena -> make();
+            copy -> parent = above;
+            copy -> to_prove_remainder = (*step) -> to_prove_remainder;
+            copy -> applied_rule = (*step) -> applied_rule;
+            copy -> depth = above -> depth + 1;
+
+            above = copy;
+        }
+    }
+
+    return above;
+}
+
+// A proof of the node's goal was found, ending in leaf. Inside a conjunct, it only completes
+// the split goal once every other conjunct has a proof too. Otherwise the ask is proven.
+static void report(Env *env, ThreadQueue *results, ProofTreeNode *node, ProofTreeNode *leaf, NodeArena *arena) {
+    vector<ProofTreeNode*> leaves;
+
+    while (node -> conjunct != nullptr) {
+        ProofTreeNode *conjunction = node -> conjunct -> parent;
+        if (!env -> splits -> prove(conjunction, node -> conjunct, leaf, leaves)) return;
+
+        leaf = joinProofs(conjunction, leaves, arena);
+        node = conjunction;
+    }
+
+    found(env, results, leaf);
+}
+
+// Check if the node is part of a conjunct that another worker already proved.
+static bool provedConjunct(Env *env, ProofTreeNode *node) {
+    if (node -> conjunct == nullptr) return false;
+    return env -> splits -> proved(node -> conjunct -> parent, node -> conjunct);
+}
+
+// Split a conjunction into one goal per side, searched separately (and by all workers). Proving
+// the sides on their own costs the sum of their searches, rather than the product it costs to
+// rewrite the whole conjunction at once. Splitting applies no rule, so the sides keep the depth.
+static void splitConjunction(Env *env, Scheduler *scheduler, size_t worker, ProofTreeNode *node) {
+    NodeArena *arena = scheduler -> arena(worker);
+    Heuristic heuristic = heuristicFor(env -> ask_heuristic);
+
+    vector<ProofTreeNode*> conjuncts;
+
+    for (TermId side : env -> terms -> get(node -> to_prove_remainder).sub_terms) {
+        ProofTreeNode *conjunct = arena -> make();
+        conjunct -> parent = node;
+        conjunct -> to_prove_remainder = side;
+        conjunct -> depth = node -> depth;
+        conjunct -> conjunct = conjunct;
+
+        if (env -> ask_search == SEARCH_BEST_FIRST) conjunct -> cost = conjunct -> depth + heuristic(env, conjunct);
+
+        conjuncts.push_back(conjunct);
+    }
+
+    // Recorded before any side is searched, so no proof of a side can be missed
+    env -> splits -> split(node, conjuncts);
+
+    ProofTreeNode **tail = &node -> first_child;
+    while (*tail != nullptr) tail = &(*tail) -> next_sibling;
+
+    for (ProofTreeNode *conjunct : conjuncts) {
+        *tail = conjunct;
+        tail = &conjunct -> next_sibling;
+
+        scheduler -> push(worker, conjunct);
+    }
+}
+
+// The whole tree below the ask was searched without finding a proof, so no node in it has a proof
+// in the steps it had left (or the ask would have one). Remember that for later searches.
+static void recordFailures(Env *env, ProofTreeNode *root, size_t recursion_limit) {
+    vector<ProofTreeNode*> stack = {root};
+
+    while (!stack.empty()) {
+        ProofTreeNode *current = stack.back();
+        stack.pop_back();
+
+        // A proven side of a split goal doesn't fail, even if the other side did
+        if (current -> conjunct == current && provedConjunct(env, current)) continue;
+
+        env -> failures -> fail(current -> to_prove_remainder, recursion_limit - current -> depth);
+
+        for (ProofTreeNode *child = current -> first_child; child != nullptr; child = child -> next_sibling) {
+            stack.push_back(child);
+        }
+    }
+}
+
+// The search ran out of depth, so keep the paths to the nodes it didn't expand for ask more:
+// nodes at the limit, and nodes the failure cache pruned, may have a proof with more steps.
+// Only called before recordFailures, which would make every node look pruned.
+static void saveFrontier(Env *env, ProofTreeNode *root, size_t recursion_limit) {
+    // The root itself was pruned (the same ask failed before), so keep the frontier of that ask
+    if (root -> first_child == nullptr) return;
+
+    Frontier *frontier = env -> frontier;
+    frontier -> clear();
+    frontier -> ask = root -> to_prove_remainder;
+    frontier -> search = env -> ask_search;
+    frontier -> heuristic = env -> ask_heuristic;
+
+    FrontierStep root_step;
+    root_step.goal = frontier -> goals -> copy(*env -> terms, root -> to_prove_remainder);
+
+    unordered_map<ProofTreeNode*, size_t> steps;
+    steps[root] = frontier -> add(root_step);
+
+    vector<ProofTreeNode*> stack = {root};
+
+    while (!stack.empty()) {
+        ProofTreeNode *current = stack.back();
+        stack.pop_back();
+
+        for (ProofTreeNode *child = current -> first_child; child != nullptr; child = child -> next_sibling) {
+            stack.push_back(child);
+        }
+
+        // Splits aren't kept, so the sides of a split goal can't be continued
+        if (current -> first_child != nullptr || current -> conjunct != nullptr) continue;
+        if (current -> depth < recursion_limit && !env -> failures -> failed(current -> to_prove_remainder, recursion_limit - current -> depth)) continue;
+
+        // Add the part of the path that isn't stored yet, parents first
+        vector<ProofTreeNode*> path;
+        for (ProofTreeNode *node = current; steps.find(node) == steps.end(); node = node -> parent) path.push_back(node);
+
+        for (auto node = path.rbegin(); node != path.rend(); node++) {
+            FrontierStep step;
+            step.goal = frontier -> goals -> copy(*env -> terms, (*node) -> to_prove_remainder);
+            step.rule = (*node) -> applied_rule;
+            step.parent = steps[(*node) -> parent];
+
+            steps[*node] = frontier -> add(step);
+        }
+
+        frontier -> addLeaf(steps[current]);
+    }
+}
+
+// Continue the last ask from its frontier instead of expanding the root again. The paths to the
+// frontier are rebuilt under the root, with nothing left to search above the frontier, and the
+// frontier nodes get ask_more levels below them.
+static void resumeFrontier(Env *env, Scheduler *scheduler, size_t worker, ProofTreeNode *root, size_t recursion_limit) {
+    const Frontier *frontier = env -> frontier;
+    NodeArena *arena = scheduler -> arena(worker);
+
+    size_t start = recursion_limit - std::min(env -> ask_more, recursion_limit);
+    Heuristic heuristic = heuristicFor(env -> ask_heuristic);
+
+    // Steps are stored parents first, so every parent is rebuilt before its children
+    vector<ProofTreeNode*> nodes = {root};
+
+    for (size_t i = 1; i < frontier -> size(); i++) {
+        const FrontierStep &step = frontier -> get(i);
+        ProofTreeNode *parent = nodes[step.parent];
+
+        ProofTreeNode *node = arena -> make();
+        node -> parent = parent;
+        node -> to_prove_remainder = env -> terms -> copy(*frontier -> goals, step.goal);
+        node -> applied_rule = step.rule;
+        node -> depth = recursion_limit;
+
+        node -> next_sibling = parent -> first_child;
+        parent -> first_child = node;
+
+        nodes.push_back(node);
+    }
+
+    // Another leaf with the same goal is searched instead, so a repeated leaf is taken out of the tree,
+    // along with the path nodes left without children. Otherwise the next frontier would keep a dead end.
+    vector<ProofTreeNode*> leaves;
+
+    for (size_t leaf : frontier -> leaves()) {
+        ProofTreeNode *node = nodes[leaf];
+        node -> depth = start;
+
+        if (env -> visited -> visit(node -> to_prove_remainder, node -> depth)) {
+            leaves.push_back(node);
+            continue;
+        }
+
+        while (node != root && node -> first_child == nullptr) {
+            ProofTreeNode **link = &node -> parent -> first_child;
+            while (*link != node) link = &(*link) -> next_sibling;
+            *link = node -> next_sibling;
+
+            node = node -> parent;
+        }
+    }
+
+    // The tree is only shared once it's complete, so no other worker sees it change
+    for (ProofTreeNode *node : leaves) {
+        if (env -> ask_search == SEARCH_BEST_FIRST) node -> cost = node -> depth + heuristic(env, node);
+        scheduler -> push(worker, node);
+    }
+}
+
+// Check if a fact in the store generalizes the term, and set context to the bindings of their match.
+// Lemmas only bind their variables: any other value was part of what their ask proved.
+static size_t findFact(Env *env, const FactStore *store, TermId term, MatchContext &context) {
+    for (size_t candidate : store -> candidates(term)) {
+        MatchContext attempt;
+        attempt.exact_values = store == env -> lemmas;
+
+        if (match(env, store -> get(candidate).term, term, attempt) == MATCH_OK) {
+            context = attempt;
+            return candidate;
+        }
+    }
+
+    return NO_FACT;
+}
+
+// Build the derivation of a fact below the node whose goal it proves, and return the new leaf.
+// In backward terms, each fact is the goal left after applying the rule that derived its child.
+// The fact may be more general than the goal, so its derivation is instantiated with the bindings of their match.
+static ProofTreeNode *factProof(Env *env, const FactStore *store, size_t fact, const MatchContext &context, ProofTreeNode *child, NodeArena *arena) {
+    for (size_t current = fact; store -> get(current).parent != NO_FACT; current = store -> get(current).parent) {
+        ProofTreeNode *node = arena -> make();
+        node -> parent = child;
+        node -> applied_rule = store -> get(current).rule;
+        node -> to_prove_remainder = substitute(env, store -> get(store -> get(current).parent).term, context);
+        node -> depth = child -> depth + 1;
+
+        child = node;
+    }
+
+    return child;
+}
+
+// If an earlier ask proved the node's goal (or a more general one), finish the proof with its lemma.
+static ProofTreeNode *lemmaProof(Env *env, ProofTreeNode *node, NodeArena *arena) {
+    if (env -> lemmas -> size() == 0) return nullptr;
+
+    MatchContext context;
+    size_t lemma = findFact(env, env -> lemmas, node -> to_prove_remainder, context);
+    if (lemma == NO_FACT) return nullptr;
+
+    return factProof(env, env -> lemmas, lemma, context, node, arena);
+}
+
+// Every goal on a proof's path is proven by the part of the proof below it, so keep them all for later asks
+// (out of the ask's scratch terms). A new lemma closes its goal at no cost, so goals that failed before
+// may be provable now: forget the failures.
+static void recordLemmas(Env *env, ProofTreeNode *leaf) {
+    size_t below = NO_FACT;
+    TermId rule = NO_TERM;
+    bool added = false;
+
+    for (ProofTreeNode *current = leaf, *previous = nullptr; current != nullptr; previous = current, current = current -> parent) {
+        // The node below started the proof of a conjunct, which this goal doesn't follow from
+        if (previous != nullptr && rule == NO_TERM) {
+            // The split goal needs the proofs of all its conjuncts, which a lemma can't hold
+            if (joins(env, current, previous)) break;
+            below = NO_FACT;
+        }
+
+        TermId goal = env -> terms -> keep(current -> to_prove_remainder);
+        size_t existing = env -> lemmas -> find(goal);
+
+        if (existing != NO_FACT) below = existing;
+
+        else {
+            Fact lemma;
+            lemma.term = goal;
+            lemma.parent = below;
+            lemma.rule = rule;
+
+            below = env -> lemmas -> add(lemma);
+            added = true;
+        }
+
+        rule = current -> applied_rule;
+    }
+
+    if (added) env -> failures -> clear();
+}
+
+size_t saturate(Env *env, size_t max_facts) {
+    env -> facts -> clear();
+
+    // Like lemmas, the new facts may prove goals that failed before
+    env -> failures -> clear();
+
+    // Given clause loop. Passive facts wait in derivation order (so shorter derivations win),
+    // and each one is either dropped as subsumed or added to the store and used to derive more.
+    queue<Fact> passive;
+
+    for (TermId rule : env -> rule_terms) {
+        const Term &term = env -> terms -> get(rule);
+        if (term.rule_op == IMPLIES_SYMBOL || term.rule_op == EQUIV_SYMBOL) continue;
+
+        Fact axiom;
+        axiom.term = rule;
+        passive.push(axiom);
+    }
+
+    while (!passive.empty() && env -> facts -> size() < max_facts) {
+        Fact given = passive.front();
+        passive.pop();
+
+        MatchContext context;
+        if (env -> facts -> contains(given.term) || findFact(env, env -> facts, given.term, context) != NO_FACT) continue;
+
+        size_t given_id = env -> facts -> add(given);
+
+        for (RuleCandidate candidate : env -> rule_index -> forwardRules(given.term)) {
+            Fact derived;
+            derived.parent = given_id;
+            derived.rule = candidate.rule;
+
+            if (tryForwardRule(env, candidate.rule, given.term, candidate.direction, derived.term) == MATCH_OK) {
+                passive.push(derived);
+            }
+        }
+    }
+
+    return env -> facts -> size();
+}
+
+// The goals an ask makes are interned in the term store's scratch space, which is dropped when the ask
+// returns or throws. Lemmas are kept out of it, and failures of scratch goals are forgotten.
+struct AskScratch {
+    Env *env;
+
+    AskScratch(Env *env) : env(env) {
+        env -> terms -> openScratch();
+    }
+
+    ~AskScratch() {
+        env -> failures -> forgetScratch();
+        env -> terms -> dropScratch();
+    }
+};
+
+string runAsk(Env *env, Scheduler *scheduler, ThreadQueue *results) {
     // Initialize root rule
     RuleTree *ask = env -> ask_rule;
 
     if (ask == nullptr) throw "Invalid Ask query";
 
-    ProofTreeNode *tree_root = new ProofTreeNode();
+    env -> cancel -> reset(env -> timeout, env -> node_budget);
+    scheduler -> unlock();
+    results -> unlock();
+
+    TermId goal = env -> intern(ask);
+    AskScratch scratch(env);
+
+    // A new ask can't be continued from another ask's frontier
+    if (env -> frontier -> ask != goal) env -> frontier -> clear();
+
+    // The ask is already a valid rule, so the proof is empty
+    if (matchesRule(env, goal)) return "";
+
+    // The ask follows from a saturated fact or an earlier ask, so the proof is its derivation
+    for (const FactStore *store : {env -> facts, env -> lemmas}) {
+        MatchContext context;
+        size_t fact = findFact(env, store, goal, context);
+        if (fact == NO_FACT) continue;
+
+        NodeArena arena;
+        ProofTreeNode *root = arena.make();
+        root -> to_prove_remainder = goal;
+
+        return showProof(env, factProof(env, store, fact, context, root, &arena));
+    }
+
+    // No worker is running yet, so the first worker's arena is free to use
+    ProofTreeNode *tree_root = scheduler -> arena(0) -> make();
+
+    tree_root -> to_prove_remainder = goal;
+    tree_root -> applied_rule = NO_TERM;
+
+    env -> visited -> clear();
+    env -> visited -> visit(tree_root -> to_prove_remainder, tree_root -> depth);
+    env -> meetings -> clear();
+    env -> splits -> clear();
+
+    // Both halves of a bidirectional search go one level at a time, so they meet near the middle
+    scheduler -> setPrioritized(env -> ask_search == SEARCH_BEST_FIRST || env -> ask_search == SEARCH_BIDIRECTIONAL);
 
-    tree_root -> to_prove_remainder = ask;
-    tree_root -> applied_rule = nullptr;
+    // The workers expand the tree from here, stealing nodes from each other as needed.
+    // The first result is either a proof or nullptr (search exhausted / interrupted).
+    scheduler -> push(0, tree_root);
+    ProofTreeNode *node = results -> pop();
 
-    size_t task_count = 0;
+    // Set if the proof was found where the two halves met
+    ProofTreeNode *forward = env -> meetings -> partner(node);
 
-    expandNode(tree_root, env);
-    for (ProofTreeNode *child : tree_root -> children) {
-        tasks -> push(child);
-        task_count++;
+    // Stop the other workers, and drop the remaining work
+    if (node != nullptr) {
+        env -> cancel -> cancel(CANCEL_FOUND);
+        scheduler -> lock();
     }
 
-    // Merge from threads and output the final result
-    for (size_t i = 0; i < task_count; i++) {
-        ProofTreeNode *node = results -> pop();
+    // Workers may still be looking at the tree, so let them finish before freeing it
+    scheduler -> wait();
 
-        if (node != nullptr) {
-            string proof = showProof(node);
+    // Drop results from workers that also found a proof
+    results -> unlock();
+    results -> clear();
 
-            // Send SIGINT to stop the other threads and empty the queues
-            raise(SIGINT);
+    string proof;
 
-            delete tree_root;
-            return proof;
+    if (node != nullptr) {
+        env -> frontier -> clear();
+
+        NodeArena stitched;
+        ProofTreeNode *leaf = forward == nullptr ? node : stitchProof(node, forward, &stitched);
+
+        proof = showProof(env, leaf);
+        recordLemmas(env, leaf);
+
+        // Remember which rules were useful, for the history heuristic
+        for (ProofTreeNode *current = leaf; current != nullptr; current = current -> parent) {
+            if (current -> applied_rule != NO_TERM) env -> rule_successes[current -> applied_rule]++;
+        }
+    }
+
+    scheduler -> resetArenas();
+
+    if (node == nullptr) {
+        switch (env -> cancel -> reason()) {
+            case CANCEL_INTERRUPT: throw "SIGINT: User interrupt received";
+            case CANCEL_DEADLINE: throw "DeadlineExceeded: Ran out of time before finding a proof";
+            case CANCEL_BUDGET: throw "NodeBudgetExceeded: Processed too many nodes before finding a proof";
+            default: throw "RecursionLimitReached: Was unable to prove the rule";
         }
     }
 
-    delete tree_root;
-    throw "RecursionLimitReached: Was unable to prove the rule"; 
+    return proof;
 
 }
 
-ProofTreeNode *runAskWorker(Env *env, size_t recursion_limit, ProofTreeNode *root) {
-    // Initialize root rule    
-    queue<ProofTreeNode*> next_rules;
-    next_rules.push(root);
+void runSchedulerWorker(Env *env, Scheduler *scheduler, ThreadQueue *results, size_t worker, size_t recursion_limit) {
+    while (true) {
+        ProofTreeNode *node = scheduler -> pop(worker);
 
-    size_t states_to_expand = 1;
-    size_t next_layer_states = 0;
+        // Scheduler was shut down
+        if (node == nullptr) return;
 
-    // Use standard BFS with a recursion limit
-    while (!next_rules.empty()) {
-        ProofTreeNode *current = next_rules.front();
-        next_rules.pop();
+        ProofTreeNode *leaf;
+
+        try {
+            // The ask was stopped, so drop this node
+            if (env -> cancel -> charge()) throw "Cancelled: The ask was stopped";
 
-        // Check if the rule (or its substitution) is equal (up to varsubs) to an existing rule. 
-        // If so, print the proof and return.
-        for (RuleTree *rule : env -> rules) {
-            try {
-                generalize(env, rule, current -> to_prove_remainder, map<string, RuleTree*>());
+            // The forward half starts from every axiom. They are pushed before the root is
+            // finished, so the search can't look exhausted before they are taken.
+            if (env -> ask_search == SEARCH_BIDIRECTIONAL && node -> parent == nullptr && !node -> forward) {
+                for (TermId rule : env -> rule_terms) {
+                    const Term &term = env -> terms -> get(rule);
+                    if (term.rule_op == IMPLIES_SYMBOL || term.rule_op == EQUIV_SYMBOL) continue;
 
-                if (stop_ask) throw "SIGINT: User interrupt received";
-                else return current;
-            } catch (char const *e) {
-                if (stop_ask) throw "SIGINT: User interrupt received";
+                    ProofTreeNode *axiom = scheduler -> arena(worker) -> make();
+                    axiom -> to_prove_remainder = rule;
+                    axiom -> forward = true;
+
+                    scheduler -> push(worker, axiom);
+                }
             }
-        }
 
-        // Apply both directions
-        try {
-            // Apply then expand and push back
-            RuleTree *new_rule = applyRule(env, current -> applied_rule, current -> to_prove_remainder, true);
-            delete current -> to_prove_remainder;
-            current -> to_prove_remainder = new_rule;
+            // ask more: the root was already expanded by the last ask
+            if (env -> ask_more > 0 && node -> parent == nullptr) {
+                resumeFrontier(env, scheduler, worker, node, recursion_limit);
+            }
+
+            // Another worker already proved this side of a split goal
+            else if (provedConjunct(env, node)) {
+                // Drop the node
+            }
+
+            // Search the whole subtree depth first, keeping only the nodes on the current path
+            else if (env -> ask_search == SEARCH_IDDFS && node -> depth >= IDDFS_SPLIT_DEPTH) {
+                leaf = runIddfsWorker(env, recursion_limit, node, scheduler -> arena(worker));
+                report(env, results, node, leaf, scheduler -> arena(worker));
+            }
+
+            // Derive facts from the axioms, for the backward half to meet
+            else if (node -> forward) {
+                vector<ProofTreeNode*> partners;
+                bool fresh = env -> meetings -> addForward(node -> to_prove_remainder, node, partners);
+
+                for (ProofTreeNode *backward : partners) {
+                    if (meets(env, backward, node, recursion_limit)) {
+                        found(env, results, backward);
+                        break;
+                    }
+                }
+
+                if (fresh && node -> depth < depthLimit(env, node, recursion_limit)) {
+                    expandForward(node, env, scheduler -> arena(worker));
+
+                    for (ProofTreeNode *child = node -> first_child; child != nullptr; child = child -> next_sibling) {
+                        child -> cost = child -> depth;
+                        scheduler -> push(worker, child);
+                    }
+                }
+            }
+
+            // If the goal is an existing rule, this node ends the proof.
+            else if (matchesRule(env, node -> to_prove_remainder)) {
+                report(env, results, node, node, scheduler -> arena(worker));
+            } 
+
+            // An earlier ask already proved the goal
+            else if ((leaf = lemmaProof(env, node, scheduler -> arena(worker))) != nullptr) {
+                report(env, results, node, leaf, scheduler -> arena(worker));
+            }
+
+            // An earlier search showed there is no proof in the steps left
+            else if (env -> failures -> failed(node -> to_prove_remainder, recursion_limit - node -> depth)) {
+                // Drop the node
+            }
 
-            expandNode(current, env);
-            next_layer_states += current -> children.size();
+            // The goal follows from a fact the forward half already derived
+            else if (env -> ask_search == SEARCH_BIDIRECTIONAL && meetsForward(env, node, recursion_limit)) {
+                found(env, results, node);
+            }
             
-            for (ProofTreeNode *child : current -> children) next_rules.push(child);
+            else {
+                // Prove the sides of a conjunction separately, as well as rewriting it as a whole
+                if (env -> ask_search != SEARCH_BIDIRECTIONAL && isConjunction(env, node -> to_prove_remainder)) {
+                    splitConjunction(env, scheduler, worker, node);
+                }
+
+                if (node -> depth < depthLimit(env, node, recursion_limit)) {
+                    NodeArena *arena = scheduler -> arena(worker);
+                    ChildGenerator children(env, node);
+                    Heuristic heuristic = heuristicFor(env -> ask_heuristic);
+
+                    // Children are shared with the other workers as soon as they are made
+                    ProofTreeNode **tail = &node -> first_child;
+                    while (*tail != nullptr) tail = &(*tail) -> next_sibling;
+
+                    while (true) {
+                        size_t mark = arena -> size();
+
+                        ProofTreeNode *child = children.next(arena);
+                        if (child == nullptr) break;
+
+                        // The goal was already reached at the same depth or above, possibly by another worker.
+                        // Conjuncts skip this check: the table doesn't know which conjunct reached a goal, and a
+                        // proof found outside the conjunct doesn't complete it, so they search their goals anyway.
+                        if (child -> conjunct == nullptr && !env -> visited -> visit(child -> to_prove_remainder, child -> depth)) {
+                            arena -> rollback(mark);
+                            continue;
+                        }
+
+                        // A*-style cost: the path so far plus the estimate of what's left
+                        if (env -> ask_search == SEARCH_BEST_FIRST) child -> cost = child -> depth + heuristic(env, child);
+                        else if (env -> ask_search == SEARCH_BIDIRECTIONAL) child -> cost = child -> depth;
 
+                        *tail = child;
+                        tail = &child -> next_sibling;
+
+                        scheduler -> push(worker, child);
+                    }
+                }
+            }
         } catch (char const *e) {
-            // Could not apply the rule, so continue
+            // Cancelled, so drop this node
         }
 
-        try {
-            // Apply then expand and push back
-            RuleTree *new_rule = applyRule(env, current -> applied_rule, current -> to_prove_remainder, false);
-            delete current -> to_prove_remainder;
-            current -> to_prove_remainder = new_rule;
+        // Drop the remaining work, and wake up runAsk if it is still waiting for a result
+        if (env -> cancel -> cancelled()) {
+            scheduler -> lock();
+            if (env -> cancel -> reason() != CANCEL_FOUND) results -> lock();
+        }
 
-            expandNode(current, env);
-            next_layer_states += current -> children.size();
+        // Nothing left anywhere and no proof found
+        if (scheduler -> finish()) {
+            // Forward nodes don't lead back to the ask, so only one half of the tree could be recorded
+            if (env -> ask_search != SEARCH_BIDIRECTIONAL && !env -> cancel -> cancelled()) {
+                ProofTreeNode *root = node;
+                while (root -> parent != nullptr) root = root -> parent;
 
-            for (ProofTreeNode *child : current -> children) next_rules.push(child);
+                // Iterative deepening rolls back its subtrees, so its frontier is gone
+                if (env -> ask_search != SEARCH_IDDFS) saveFrontier(env, root, recursion_limit);
+                recordFailures(env, root, recursion_limit);
+            }
 
-        } catch (char const *e) {
-            // Could not apply the rule, so continue
+            results -> push(nullptr);
+        }
+    }
+}
+
+ProofTreeNode *runAskWorker(Env *env, size_t recursion_limit, ProofTreeNode *root, NodeArena *arena) {
+    // Initialize root rule    
+    queue<ProofTreeNode*> next_rules;
+    next_rules.push(root);
+
+    size_t states_to_expand = 1;
+    size_t next_layer_states = 0;
+
+    // Use standard BFS with a recursion limit
+    while (!next_rules.empty()) {
+        ProofTreeNode *current = next_rules.front();
+        next_rules.pop();
+
+        // If the goal is an existing rule, this node ends the proof.
+        if (matchesRule(env, current -> to_prove_remainder)) return current;
+
+        ProofTreeNode *leaf = lemmaProof(env, current, arena);
+        if (leaf != nullptr) return leaf;
+
+        // Children already have their rule applied, so just push them back
+        expandNode(current, env, arena);
+        dropVisited(env, current);
+
+        for (ProofTreeNode *child = current -> first_child; child != nullptr; child = child -> next_sibling) {
+            next_rules.push(child);
+            next_layer_states++;
         }
 
         // Check if we've reached the recursion limit
@@ -133,14 +754,220 @@ ProofTreeNode *runAskWorker(Env *env, size_t recursion_limit, ProofTreeNode *roo
 
 }
 
-void expandNode(ProofTreeNode *node, Env *env) {
-    for (RuleTree *rule : env -> rules) {
-        ProofTreeNode *child = new ProofTreeNode();
+// Number of nodes in a term.
+static size_t termSize(Env *env, TermId id) {
+    size_t size = 1;
+
+    for (TermId child : env -> terms -> get(id).sub_terms) {
+        size += termSize(env, child);
+    }
+
+    return size;
+}
+
+// Number of operators and values in a term that no fact mentions.
+static size_t unknownSymbols(Env *env, TermId id) {
+    const Term &term = env -> terms -> get(id);
+    size_t unknown = 0;
+
+    if (term.rule_op != NO_SYMBOL && !env -> rule_index -> inFact(term.rule_op)) unknown++;
+    if (term.rule_value != NO_SYMBOL && !env -> rule_index -> inFact(term.rule_value)) unknown++;
+
+    for (TermId child : term.sub_terms) {
+        unknown += unknownSymbols(env, child);
+    }
+
+    return unknown;
+}
+
+double sizeHeuristic(Env *env, const ProofTreeNode *node) {
+    return termSize(env, node -> to_prove_remainder);
+}
+
+double overlapHeuristic(Env *env, const ProofTreeNode *node) {
+    return unknownSymbols(env, node -> to_prove_remainder);
+}
+
+double historyHeuristic(Env *env, const ProofTreeNode *node) {
+    auto successes = env -> rule_successes.find(node -> applied_rule);
+    double used = successes == env -> rule_successes.end() ? 0 : successes -> second;
+
+    return sizeHeuristic(env, node) / (1 + used);
+}
+
+Heuristic heuristicFor(HeuristicKind kind) {
+    switch (kind) {
+        case HEURISTIC_SIZE:
+            return sizeHeuristic;
+        case HEURISTIC_OVERLAP:
+            return overlapHeuristic;
+        case HEURISTIC_HISTORY:
+            return historyHeuristic;
+    }
+
+    return sizeHeuristic;
+}
+
+// Check if the goal already appears on the path to the root (applying rules went in a circle).
+static bool onPath(ProofTreeNode *node, TermId goal) {
+    for (ProofTreeNode *current = node; current != nullptr; current = current -> parent) {
+        if (current -> to_prove_remainder == goal) return true;
+    }
+
+    return false;
+}
+
+// Depth first search down to the given depth. Nodes of failed subtrees are rolled back,
+// so only the nodes on the current path are alive.
+// Sets cut if a goal in the subtree was skipped for repeating one on the path.
+static ProofTreeNode *depthLimitedSearch(Env *env, ProofTreeNode *node, size_t depth_limit, NodeArena *arena, bool &cut) {
+    // The whole subtree is searched without going through the scheduler, so every node is charged here
+    if (env -> cancel -> charge()) throw "Cancelled: The ask was stopped";
+
+    if (matchesRule(env, node -> to_prove_remainder)) return node;
+
+    ProofTreeNode *leaf = lemmaProof(env, node, arena);
+    if (leaf != nullptr) return leaf;
+
+    size_t remaining = depth_limit - node -> depth;
+
+    if (env -> failures -> failed(node -> to_prove_remainder, remaining)) return nullptr;
+
+    bool subtree_cut = false;
+
+    // Prove the sides of a conjunction one after the other, as well as rewriting it as a whole.
+    // Splitting applies no rule, so the sides keep the depth.
+    if (isConjunction(env, node -> to_prove_remainder)) {
+        const vector<TermId> &sides = env -> terms -> get(node -> to_prove_remainder).sub_terms;
+
+        size_t mark = arena -> size();
+        vector<ProofTreeNode*> leaves;
+
+        for (TermId side : sides) {
+            if (onPath(node, side)) {
+                subtree_cut = true;
+                break;
+            }
+
+            ProofTreeNode *conjunct = arena -> make();
+            conjunct -> parent = node;
+            conjunct -> to_prove_remainder = side;
+            conjunct -> depth = node -> depth;
+            conjunct -> conjunct = conjunct;
+
+            if ((leaf = depthLimitedSearch(env, conjunct, depth_limit, arena, subtree_cut)) == nullptr) break;
+            leaves.push_back(leaf);
+        }
+
+        if (leaves.size() == sides.size()) return joinProofs(node, leaves, arena);
+        arena -> rollback(mark);
+    }
+
+    if (remaining == 0) return nullptr;
+
+    ChildGenerator children(env, node);
+
+    // Children are made one at a time and only reached through their parent pointer,
+    // so a proof stops the remaining rules from being applied at all
+    while (true) {
+        size_t mark = arena -> size();
+
+        ProofTreeNode *child = children.next(arena);
+        if (child == nullptr) break;
+
+        if (onPath(node, child -> to_prove_remainder)) subtree_cut = true;
+        else if ((leaf = depthLimitedSearch(env, child, depth_limit, arena, subtree_cut)) != nullptr) return leaf;
+
+        arena -> rollback(mark);
+    }
+
+    // A skipped goal depends on the path to it, so the failure is only certain without one
+    if (!subtree_cut) env -> failures -> fail(node -> to_prove_remainder, remaining);
+    cut = cut || subtree_cut;
+
+    return nullptr;
+}
+
+ProofTreeNode *runIddfsWorker(Env *env, size_t recursion_limit, ProofTreeNode *root, NodeArena *arena) {
+    // Raise the depth limit one level at a time, so the shortest proof in the subtree is found first
+    for (size_t depth_limit = root -> depth; depth_limit <= recursion_limit; depth_limit++) {
+        bool cut = false;
+
+        ProofTreeNode *leaf = depthLimitedSearch(env, root, depth_limit, arena, cut);
+        if (leaf != nullptr) return leaf;
+    }
+
+    throw "RecursionLimitReached: Was unable to prove the rule";
+
+}
+
+ChildGenerator::ChildGenerator(Env *env, ProofTreeNode *node) : env(env), node(node) {
+    // Only rules whose conclusion has the right shape are tried
+    candidates = env -> rule_index -> applicableRules(node -> to_prove_remainder);
+}
+
+ProofTreeNode *ChildGenerator::next(NodeArena *arena) {
+    while (position < candidates.size()) {
+        if (env -> cancel -> cancelled()) throw "Cancelled: The ask was stopped";
+
+        RuleCandidate candidate = candidates[position++];
+        TermId goal;
+
+        // Could not apply the rule (eg. the types don't match), so try the next one
+        if (tryApplyRule(env, candidate.rule, node -> to_prove_remainder, candidate.direction, goal) != MATCH_OK) {
+            continue;
+        }
+
+        // Terms are shared, so the child just references the new goal and the rule
+        ProofTreeNode *child = arena -> make();
+        child -> parent = node;
+        child -> to_prove_remainder = goal;
+        child -> applied_rule = candidate.rule;
+        child -> depth = node -> depth + 1;
+        child -> conjunct = node -> conjunct;
+
+        return child;
+    }
+
+    return nullptr;
+}
+
+void expandNode(ProofTreeNode *node, Env *env, NodeArena *arena) {
+    // Append in candidate order, so the search order stays deterministic
+    ProofTreeNode **tail = &node -> first_child;
+    while (*tail != nullptr) tail = &(*tail) -> next_sibling;
+
+    ChildGenerator children(env, node);
+
+    for (ProofTreeNode *child = children.next(arena); child != nullptr; child = children.next(arena)) {
+        *tail = child;
+        tail = &child -> next_sibling;
+    }
+}
+
+void expandForward(ProofTreeNode *node, Env *env, NodeArena *arena) {
+    ProofTreeNode **tail = &node -> first_child;
+    while (*tail != nullptr) tail = &(*tail) -> next_sibling;
+
+    // Only rules whose premise has the right shape are tried
+    for (RuleCandidate candidate : env -> rule_index -> forwardRules(node -> to_prove_remainder)) {
+        if (env -> cancel -> cancelled()) throw "Cancelled: The ask was stopped";
+
+        TermId fact;
+
+        if (tryForwardRule(env, candidate.rule, node -> to_prove_remainder, candidate.direction, fact) != MATCH_OK) {
+            continue;
+        }
+
+        ProofTreeNode *child = arena -> make();
         child -> parent = node;
-        child -> to_prove_remainder = new RuleTree(*node -> to_prove_remainder);
-        child -> applied_rule = new RuleTree(*rule);
+        child -> to_prove_remainder = fact;
+        child -> applied_rule = candidate.rule;
+        child -> depth = node -> depth + 1;
+        child -> forward = true;
 
-        node -> children.insert(child);
+        *tail = child;
+        tail = &child -> next_sibling;
     }
 }
 
@@ -166,35 +993,95 @@ void expandNode(ProofTreeNode *node, Env *env) {
  * 
  */
 
-RuleTree *applyRule(Env *env, RuleTree *apply, RuleTree *victim, bool direction) {
+// Match victim against from, and build to with the same bindings.
+static MatchStatus rewrite(Env *env, TermId from, TermId to, TermId victim, TermId &result) {
+    MatchContext context;
+    MatchStatus status = match(env, from, victim, context);
+    if (status != MATCH_OK) return status;
+
+    result = substitute(env, to, context);
+    return MATCH_OK;
+}
+
+MatchStatus tryApplyRule(Env *env, TermId apply_id, TermId victim, bool direction, TermId &result) {
+    const Term &apply = env -> terms -> get(apply_id);
+
+    TermId from;
+    TermId to;
+
     // Check for valid operators
-    if (apply -> rule_op == "-->" && direction) {
-        // If this throws an error just go up to the next exec level
-        map<string, RuleTree*> subs = generalize(env, apply -> sub_rules[1], victim, map<string, RuleTree*>());
-        return substitute(env, apply -> sub_rules[0],  subs);
-    } else if (apply -> rule_op == "--<>" && direction) {
-        map<string, RuleTree*> subs = generalize(env, apply -> sub_rules[1], victim, map<string, RuleTree*>());
-        return substitute(env, apply -> sub_rules[0],  subs);
+    if (apply.rule_op == IMPLIES_SYMBOL && direction) {
+        from = apply.sub_terms[1];
+        to = apply.sub_terms[0];
+    } else if (apply.rule_op == EQUIV_SYMBOL && direction) {
+        from = apply.sub_terms[1];
+        to = apply.sub_terms[0];
     }
 
-    else if (apply -> rule_op == "--<>") {
-        map<string, RuleTree*> subs = generalize(env, apply -> sub_rules[0], victim, map<string, RuleTree*>());
-        return substitute(env, apply -> sub_rules[1],  subs);
+    else if (apply.rule_op == EQUIV_SYMBOL) {
+        from = apply.sub_terms[0];
+        to = apply.sub_terms[1];
     }
-    // Rule could not be applied, so throw an error
-    throw "GeneralizeError: Can only apply rules with --> or --<> (or incorrect direction)";
+
+    // Rule could not be applied
+    else return MATCH_WRONG_DIRECTION;
+
+    return rewrite(env, from, to, victim, result);
 }
 
-string showProof(ProofTreeNode *leaf) {
+MatchStatus tryForwardRule(Env *env, TermId apply_id, TermId fact, bool direction, TermId &result) {
+    const Term &apply = env -> terms -> get(apply_id);
+
+    // The reverse of tryApplyRule: match the premise, derive the conclusion
+    if (apply.rule_op == IMPLIES_SYMBOL && direction) {
+        return rewrite(env, apply.sub_terms[0], apply.sub_terms[1], fact, result);
+    }
+
+    if (apply.rule_op == EQUIV_SYMBOL && direction) {
+        return rewrite(env, apply.sub_terms[0], apply.sub_terms[1], fact, result);
+    }
+
+    if (apply.rule_op == EQUIV_SYMBOL) {
+        return rewrite(env, apply.sub_terms[1], apply.sub_terms[0], fact, result);
+    }
+
+    return MATCH_WRONG_DIRECTION;
+}
+
+TermId applyRule(Env *env, TermId apply, TermId victim, bool direction) {
+    TermId result;
+    MatchStatus status = tryApplyRule(env, apply, victim, direction, result);
+
+    if (status != MATCH_OK) throw matchError(status);
+    return result;
+}
+
+RuleTree *applyRule(Env *env, RuleTree *apply, RuleTree *victim, bool direction) {
+    TermId applied = applyRule(env, env -> intern(apply), env -> intern(victim), direction);
+    return env -> toRuleTree(applied);
+}
+
+string showProof(Env *env, ProofTreeNode *leaf) {
     ostringstream output;
 
-    // The two children nodes are duplicates (recurse down and check for tautology)
-    ProofTreeNode *current = leaf -> parent;
+    // The leaf's goal is a valid rule, so every step from it up to the root is part of the proof
+    ProofTreeNode *current = leaf;
     
-    // Recurse back up the tree.
-    while (current != nullptr && current -> applied_rule != nullptr) {
-        output << "==> " << *current -> to_prove_remainder << endl;
-        output << "Apply rule " << *current -> applied_rule << endl;
+    // Recurse back up the tree. Only the root has no rule, apart from the conjuncts of split goals.
+    while (current != nullptr && (current -> applied_rule != NO_TERM || current -> parent != nullptr)) {
+        output << "==> ";
+        env -> printTerm(output, current -> to_prove_remainder);
+        output << endl;
+
+        // Each conjunct's proof ends here, and the next one (or the split goal) comes after it
+        if (current -> applied_rule == NO_TERM) {
+            output << "Conjunct proven" << endl;
+        } else {
+            output << "Apply rule ";
+            env -> printTerm(output, current -> applied_rule);
+            output << endl;
+        }
+
         output << endl;
         current = current -> parent;
     }
@@ -202,97 +1089,204 @@ string showProof(ProofTreeNode *leaf) {
     return output.str();
 }
 
-RuleTree *substitute(Env *env, RuleTree *original, map<string, RuleTree*> substitutions) {
+ProofTreeNode *stitchProof(ProofTreeNode *backward, ProofTreeNode *forward, NodeArena *arena) {
+    ProofTreeNode *child = backward;
+
+    // Walking the forward half back to its axiom gives the steps below the meeting point.
+    // In backward terms, each fact is the goal left after applying the rule that derived its child.
+    for (ProofTreeNode *current = forward; current -> parent != nullptr; current = current -> parent) {
+        ProofTreeNode *node = arena -> make();
+        node -> parent = child;
+        node -> applied_rule = current -> applied_rule;
+        node -> to_prove_remainder = current -> parent -> to_prove_remainder;
+        node -> depth = child -> depth + 1;
+
+        child = node;
+    }
+
+    return child;
+}
+
+string showProof(Env *env, ProofTreeNode *backward, ProofTreeNode *forward) {
+    NodeArena arena;
+    return showProof(env, stitchProof(backward, forward, &arena));
+}
+
+TermId substitute(Env *env, TermId original_id, const MatchContext &context) {
+    const Term &original = env -> terms -> get(original_id);
+
     // Base Case
-    if (substitutions.find(original -> rule_value) != substitutions.end()) {
-        return new RuleTree(*substitutions[original -> rule_value]);
+    auto found = context.variables.find(original.rule_value);
+    if (found != context.variables.end()) {
+        return found -> second;
     }
 
-    // Make a copy and recursively substitute variables
-    RuleTree *copy = new RuleTree();
-    copy -> rule_op = original -> rule_op;
-    copy -> rule_type = original -> rule_type;
-    copy -> rule_value = original -> rule_value;
+    // Nothing can change, so share the whole term
+    if (context.variables.empty() && context.type_vars.size() == 0) return original_id;
 
     // Perform type var substitutions
-    if (env -> type_var_subs.find(original -> rule_type) != env -> type_var_subs.end()) {
-        copy -> rule_type = env -> type_var_subs[original -> rule_type];
+    SymbolId rule_type = original.rule_type;
+
+    const SymbolId *type_sub = context.type_vars.lookup(original.rule_type);
+    if (type_sub != nullptr) {
+        rule_type = *type_sub;
     }
 
     // Recursive Case
-    for (RuleTree *child : original -> sub_rules) {
-        copy -> sub_rules.push_back(substitute(env, child, substitutions));
+    bool changed = rule_type != original.rule_type;
+
+    vector<TermId> sub_terms;
+    sub_terms.reserve(original.sub_terms.size());
+
+    for (TermId child : original.sub_terms) {
+        TermId new_child = substitute(env, child, context);
+
+        changed = changed || new_child != child;
+        sub_terms.push_back(new_child);
     }
 
-    return copy;
+    // Terms are immutable, so only the path down to a substituted variable is copied
+    if (!changed) return original_id;
 
-}
+    Term copy;
+    copy.rule_op = original.rule_op;
+    copy.rule_type = rule_type;
+    copy.rule_value = original.rule_value;
+    copy.sub_terms = sub_terms;
 
-map<string, RuleTree*> generalize(Env *env, RuleTree *general, RuleTree *specific, 
-    map<string, RuleTree*> substitutions) {
+    return env -> terms -> make(copy);
 
-    string rule_type = general -> rule_type;
+}
 
-    // Check for wild card (_) substitutions, which only require binding variables
-    if (general -> rule_type == "_") {
-        rule_type = specific -> rule_type;
+RuleTree *substitute(Env *env, RuleTree *original, map<string, RuleTree*> substitutions) {
+    MatchContext context;
+
+    for (auto i = substitutions.begin(); i != substitutions.end(); ++i) {
+        context.variables[env -> symbol(i -> first)] = env -> intern(i -> second);
     }
 
-    // Check if the TypeVar needs to be substituted (general)
-    else if (env -> type_var_subs.find(general -> rule_type) != env -> type_var_subs.end()) {
-        rule_type = env -> type_var_subs[general -> rule_type];
+    TermId result = substitute(env, env -> intern(original), context);
+    return env -> toRuleTree(result);
+}
+
+const char *matchError(MatchStatus status) {
+    switch (status) {
+        case MATCH_OK:
+            return "";
+        case MATCH_TYPE_MISMATCH:
+            return "GeneralizeError: Could not match rule output types.";
+        case MATCH_LITERAL_MISMATCH:
+            return "GeneralizeError: Two literals are not equal";
+        case MATCH_VARIABLE_MISMATCH:
+            return "GeneralizeError: Two variables are incompatible";
+        case MATCH_OPERATOR_MISMATCH:
+            return "GeneralizeError: Could not match the operators.";
+        case MATCH_WRONG_DIRECTION:
+            return "GeneralizeError: Can only apply rules with --> or --<> (or incorrect direction)";
     }
 
-    // Check for general being a TypeVar (no substitution so far)
-    else if (env -> type_vars.find(general -> rule_type) != env -> type_vars.end()) {
-        rule_type = specific -> rule_type;
-        env -> type_var_subs[general -> rule_type] = specific -> rule_type;
+    return "GeneralizeError: Unknown error";
+}
+
+MatchStatus match(Env *env, TermId general_id, TermId specific_id, MatchContext &context) {
+    const Term &general = env -> terms -> get(general_id);
+    const Term &specific = env -> terms -> get(specific_id);
+
+    SymbolId rule_type = general.rule_type;
+
+    // Check for wild card (_) substitutions, which only require binding variables
+    if (general.rule_type == WILDCARD_SYMBOL) {
+        rule_type = specific.rule_type;
     }
 
-    map<string, RuleTree*> new_subs = substitutions;
+    // A TypeVar (general) takes on the specific type, unless it is already bound to another one
+    else if (env -> symbols -> kind(general.rule_type) == SYMBOL_TYPEVAR) {
+        if (!context.type_vars.bind(context.type_vars.variable(general.rule_type), specific.rule_type)) return MATCH_TYPE_MISMATCH;
+        rule_type = specific.rule_type;
+    }
 
     // Check for type equality (up to generalizations)
-    if (rule_type != specific -> rule_type) {
-        throw "GeneralizeError: Could not match rule output types.";
-    }
+    if (rule_type != specific.rule_type) return MATCH_TYPE_MISMATCH;
 
     // Base Case
-    if (general -> rule_value != "") {
+    if (general.rule_value != NO_SYMBOL) {
         // Checking for literal in type_fixed (requires EXACT value)
-        if (env -> literals.find(general -> rule_value) != env -> literals.end()) {
-            if (general -> rule_value == specific -> rule_value) {
-                return new_subs;
-            } else {
-                throw "GeneralizeError: Two literals are not equal";
-            }
+        SymbolKind kind = env -> symbols -> kind(general.rule_value);
+
+        if (kind == SYMBOL_LITERAL || (context.exact_values && kind != SYMBOL_VARIABLE)) {
+            if (general.rule_value == specific.rule_value) return MATCH_OK;
+            return MATCH_LITERAL_MISMATCH;
         }
 
         // Checking for variable in type_fixed (requires a substitution)
-        // Substitution already made -> check validity
-        else if (new_subs.find(general -> rule_value) != new_subs.end()) {
-            if (*new_subs[general -> rule_value] == *specific) {
-                return new_subs;
-            } else {
-                throw "GeneralizeError: Two variables are incompatible";                
-            }            
-        } else { // No substitution present -> add one
-            new_subs[general -> rule_value] = specific;
-            return new_subs;
+        // Substitution already made -> check validity (terms are hash-consed, so compare ids)
+        auto bound = context.variables.find(general.rule_value);
+        if (bound != context.variables.end()) {
+            if (bound -> second == specific_id) return MATCH_OK;
+            return MATCH_VARIABLE_MISMATCH;
         }
 
+        // No substitution present -> add one
+        context.variables[general.rule_value] = specific_id;
+        return MATCH_OK;
     }
 
     // Bind children and recurse. If recursive case, operators must match.
-    if (general -> rule_op != specific -> rule_op) {
-        throw "GeneralizeError: Could not match the operators.";
-    }
+    if (general.rule_op != specific.rule_op) return MATCH_OPERATOR_MISMATCH;
     
     // Since the rules are already type checked,
     // they're guaranteed to have the same length
-    for (size_t i = 0; i < general -> sub_rules.size(); i++) {
-        new_subs = generalize(env, general -> sub_rules[i], specific -> sub_rules[i], new_subs);
+    for (size_t i = 0; i < general.sub_terms.size(); i++) {
+        MatchStatus status = match(env, general.sub_terms[i], specific.sub_terms[i], context);
+        if (status != MATCH_OK) return status;
     }
 
-    return new_subs;
+    return MATCH_OK;
+
+}
+
+MatchContext generalize(Env *env, TermId general, TermId specific, MatchContext context) {
+    MatchStatus status = match(env, general, specific, context);
+
+    if (status != MATCH_OK) throw matchError(status);
+    return context;
+}
+
+// Intern a rule, remembering which tree node each resulting id came from.
+static TermId internIndexed(Env *env, RuleTree *rule, map<TermId, RuleTree*> &origins) {
+    Term term;
+    term.rule_type = env -> symbol(rule -> rule_type);
+    term.rule_value = env -> symbol(rule -> rule_value);
+    term.rule_op = env -> symbol(rule -> rule_op);
+
+    for (RuleTree *child : rule -> sub_rules) {
+        term.sub_terms.push_back(internIndexed(env, child, origins));
+    }
+
+    TermId id = env -> terms -> make(term);
+    if (origins.find(id) == origins.end()) origins[id] = rule;
 
+    return id;
+}
+
+map<string, RuleTree*> generalize(Env *env, RuleTree *general, RuleTree *specific, 
+    map<string, RuleTree*> substitutions) {
+
+    map<TermId, RuleTree*> origins;
+    MatchContext context;
+
+    for (auto i = substitutions.begin(); i != substitutions.end(); ++i) {
+        context.variables[env -> symbol(i -> first)] = internIndexed(env, i -> second, origins);
+    }
+
+    TermId specific_id = internIndexed(env, specific, origins);
+    context = generalize(env, env -> intern(general), specific_id, context);
+
+    // Every bound term is a subterm of specific or one of the given substitutions.
+    map<string, RuleTree*> new_subs;
+    for (auto i = context.variables.begin(); i != context.variables.end(); ++i) {
+        new_subs[env -> symbols -> name(i -> first)] = origins[i -> second];
+    }
+
+    return new_subs;
 }
\ No newline at end of file
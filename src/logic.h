@@ -4,33 +4,144 @@
 #include <queue>
 #include <vector>
 
+#include "data/globals.h"
 #include "data/rule.h"
+#include "data/scheduler.h"
+#include "data/symbols.h"
+#include "data/term.h"
 #include "data/threadQueue.h"
 #include "data/tree.h"
+#include "data/typeUnifier.h"
 
 using std::queue;
 
-extern bool stop_ask;
+// Result of a match. Failed matches are the common case during a search, so they are
+// reported with a status instead of an exception.
+enum MatchStatus {
+    MATCH_OK,
+    MATCH_TYPE_MISMATCH,
+    MATCH_LITERAL_MISMATCH,
+    MATCH_VARIABLE_MISMATCH,
+    MATCH_OPERATOR_MISMATCH,
+    MATCH_WRONG_DIRECTION
+};
+
+// Bindings made while matching one rule against a term: variables to terms, and TypeVars to types.
+// Every match has its own context, so the Env is only read during an ask and workers never share state.
+struct MatchContext {
+    map<SymbolId, TermId> variables;
+    TypeUnifier<SymbolId> type_vars;
+
+    // Only bind declared variables, so any other value (eg. a number) must be equal.
+    // Set when matching lemmas, which were only proven for the values their ask had.
+    bool exact_values = false;
+};
+
+// The user-facing error message for a failed match.
+const char *matchError(MatchStatus status);
+
+// Estimate of how far a node is from a proof (lower is closer). Used by best first search.
+// To add a heuristic, write one of these and list it in heuristicFor and rules::heuristics.
+typedef double (*Heuristic)(Env *env, const ProofTreeNode *node);
+
+// The number of nodes in the goal.
+double sizeHeuristic(Env *env, const ProofTreeNode *node);
+
+// The number of operators and values in the goal that don't appear in any fact.
+double overlapHeuristic(Env *env, const ProofTreeNode *node);
+
+// The goal size, discounted by how often the node's rule was used in earlier proofs.
+double historyHeuristic(Env *env, const ProofTreeNode *node);
+
+// Get the function for a heuristic.
+Heuristic heuristicFor(HeuristicKind kind);
 
 /**
  * @brief Run an Ask query in the given environment
  * 
  * @param env The environment to run on. env -> ask_rule should be the rule to run.
- * @param tasks The queue for sending tasks to threads
+ * The ask stops early when env -> cancel is cancelled, or runs out of env -> timeout or env -> node_budget.
+ * Every goal on the path of a proof found by the search is added to env -> lemmas, for later asks.
+ * @param scheduler The scheduler the worker threads take nodes from
  * @param results The queue for getting results from threads
- * @return a string with the proof if the statement is PROVABLY true, or "Could not prove X" otherwise.
+ * @return a string with the proof if the statement is PROVABLY true
+ * @throws an error (string) if no proof was found, saying why the search stopped.
  */
-string runAsk(Env *env, ThreadQueue *tasks, ThreadQueue *results);
+string runAsk(Env *env, Scheduler *scheduler, ThreadQueue *results);
 
 /**
- * @brief Partial Run Ask only used in threads.
+ * @brief Body of a worker thread. Processes nodes from the scheduler until it is shut down.
+ * 
+ * @param env The environment to run on.
+ * @param scheduler The scheduler to take nodes from. Children are pushed to this worker's deque.
+ * @param results Gets the leaf of a proof, or nullptr when the search is exhausted.
+ * @param worker The index of this worker in the scheduler.
+ * @param recursion_limit Nodes at this depth are checked but not expanded.
+ */
+void runSchedulerWorker(Env *env, Scheduler *scheduler, ThreadQueue *results, size_t worker, size_t recursion_limit);
+
+/**
+ * @brief Sequential breadth first search from a single node.
  * 
  * @param env The environment to run on. env -> ask_rule should be the rule to run.
  * @param recursion_limit The max recursion depth to go to.
- * @param root The proof tree node to start from.
- * @return The leaf node (in the same tree) that reached a tautology.
+ * @param root The proof tree node to start from. Its applied_rule (if any) must already be applied.
+ * Goals that env -> visited has already seen at the same depth or above are not expanded again.
+ * A goal that a lemma in env -> lemmas generalizes is finished with the lemma's proof.
+ * @param arena The arena new nodes are allocated from. The tree is only valid until it is reset.
+ * @return The leaf node (in the same tree) whose goal is an existing rule.
+ */
+ProofTreeNode *runAskWorker(Env *env, size_t recursion_limit, ProofTreeNode *root, NodeArena *arena);
+
+/**
+ * @brief Iterative deepening depth first search from a single node.
+ * Only the proof tree nodes on the current path (and their siblings) are kept, since failed subtrees
+ * are rolled back. The goals it makes are still interned, in the term store's scratch space, until the
+ * ask ends, and its failed goals go to env -> failures (which is bounded), so those grow with the
+ * size of the search. Goals that repeat along a path are skipped, but env -> visited is not used.
+ * 
+ * @param env The environment to run on.
+ * @param recursion_limit The max depth (counted from the ask) to go to.
+ * @param root The proof tree node to start from. Its applied_rule (if any) must already be applied.
+ * @param arena The arena new nodes are allocated from. Nodes of failed subtrees are rolled back.
+ * @return The leaf node (in the same tree) whose goal is an existing rule.
  */
-ProofTreeNode *runAskWorker(Env *env, size_t recursion_limit, ProofTreeNode *root);
+ProofTreeNode *runIddfsWorker(Env *env, size_t recursion_limit, ProofTreeNode *root, NodeArena *arena);
+
+/**
+ * @brief Apply one rule to another without throwing. Used by the search loop.
+ * 
+ * @param env The environment to run in.
+ * @param apply The rule to be applied. 
+ * @param victim The rule to be applied to.
+ * @param side Which side of the --<> to expand.
+ * @param result Set to the new, transformed rule if the match succeeds.
+ * @return MATCH_OK on success, otherwise the reason the rules are incompatible.
+ */
+MatchStatus tryApplyRule(Env *env, TermId apply, TermId victim, bool side, TermId &result);
+
+/**
+ * @brief Apply a rule forwards (premise to conclusion) to a fact, without throwing.
+ * 
+ * @param env The environment to run in.
+ * @param apply The --> or --<> rule to apply.
+ * @param fact The fact to match against the premise.
+ * @param direction true to derive the right side from the left side, false for the reverse (--<> only).
+ * @param result Set to the derived fact if the match succeeds.
+ * @return MATCH_OK on success, otherwise the reason the rules are incompatible.
+ */
+MatchStatus tryForwardRule(Env *env, TermId apply, TermId fact, bool direction, TermId &result);
+
+/**
+ * @brief Derive facts from the rules by forward chaining, into env -> facts.
+ * Facts that an existing fact generalizes are dropped. Later asks are answered
+ * from the store when possible. Not thread safe: only call this while no ask is running.
+ * 
+ * @param env The environment to run in. The previous facts are replaced.
+ * @param max_facts Stop after this many facts (the closure is often infinite).
+ * @return The number of facts in the store.
+ */
+size_t saturate(Env *env, size_t max_facts);
 
 /**
  * @brief Apply one rule to another.
@@ -39,45 +150,121 @@ ProofTreeNode *runAskWorker(Env *env, size_t recursion_limit, ProofTreeNode *roo
  * @param apply The rule to be applied. 
  * @param victim The rule to be applied to.
  * @param side Which side of the --<> to expand.
- * @return RuleTree The new, transformed rules.
+ * @return TermId The new, transformed rule (interned in env -> terms).
  * @throws -1 if the rules are incompatible. 
  */
+TermId applyRule(Env *env, TermId apply, TermId victim, bool side);
+
+// RuleTree overload of applyRule. The caller owns the returned tree.
 RuleTree* applyRule(Env *env, RuleTree *apply, RuleTree *victim, bool side);
 
 /**
- * @brief Expand a Proof Tree Node by generating its children (which may or may not be valid)
+ * @brief Generates the children of a Proof Tree Node one at a time.
+ *
+ * Candidate rules are only applied when the next child is asked for, and a node is only
+ * made once its rule applied. A search that stops early (eg. depth first, on a proof)
+ * never applies the remaining rules, and never allocates their children.
+ */
+class ChildGenerator {
+    public:
+    ChildGenerator(Env *env, ProofTreeNode *node);
+
+    // Make the child for the next rule (and direction) that can be applied to the goal,
+    // or return nullptr once every candidate was tried. The child is not linked into the node's children.
+    ProofTreeNode *next(NodeArena *arena);
+
+    private:
+    Env *env;
+    ProofTreeNode *node;
+
+    vector<RuleCandidate> candidates;
+    size_t position = 0;
+};
+
+/**
+ * @brief Expand a Proof Tree Node by generating its children.
+ * One child is made for every rule (and direction) that can be applied to the node's goal.
+ * 
+ * @param node The node to expand
+ * @param env The env containing the rules to use
+ * @param arena The arena to allocate the children from
+ * @return None, modifies the node in place.
+ */
+void expandNode(ProofTreeNode *node, Env *env, NodeArena *arena);
+
+/**
+ * @brief Expand a forward node of a bidirectional search, by applying rules forwards to its fact.
+ * One child is made for every rule (and direction) whose premise matches the fact.
  * 
  * @param node The node to expand
  * @param env The env containing the rules to use
+ * @param arena The arena to allocate the children from
  * @return None, modifies the node in place.
  */
-void expandNode(ProofTreeNode *node, Env *env);
+void expandForward(ProofTreeNode *node, Env *env, NodeArena *arena);
 
 /**
  * @brief Show the full proof as a string.
- * @param leaf The leaf node containing two equal expressions.
+ * @param env The env whose term store holds the proof's terms.
+ * @param leaf The leaf node whose goal is an existing rule.
  * @return The proof. Backtracks up the tree to show every step. 
  */
-string showProof(ProofTreeNode *leaf);
+string showProof(Env *env, ProofTreeNode *leaf);
+
+/**
+ * @brief Join the two halves of a proof found by a bidirectional search.
+ * @param backward The backward node whose goal the forward node's fact generalizes.
+ * @param forward The forward node, derived from an axiom.
+ * @param arena The arena to allocate the steps of the forward half from.
+ * @return The leaf of a single proof, whose goal is the axiom the forward half started at.
+ */
+ProofTreeNode *stitchProof(ProofTreeNode *backward, ProofTreeNode *forward, NodeArena *arena);
 
 /**
- * @brief Perform the specified substitutions, then return a deep copy of the rule.
+ * @brief Show a proof found by a bidirectional search, by stitching its two halves together.
+ * @param env The env whose term store holds the proof's terms.
+ * @param backward The backward node whose goal the forward node's fact generalizes.
+ * @param forward The forward node, derived from an axiom.
+ * @return The proof, from the axiom the forward half started at up to the ask.
+ */
+string showProof(Env *env, ProofTreeNode *backward, ProofTreeNode *forward);
+
+/**
+ * @brief Perform the specified substitutions on a rule.
  * 
  * @param env The enviroment to run in.
  * @param original The original rule.
- * @param substitutions The list of substitutions. The types are assumed to match
- * @return RuleTree* A copy of the rule, with the substitutions made
+ * @param context The bindings to substitute: variables by term, and TypeVars by type. The types are assumed to match
+ * @return TermId The rule with the substitutions made. Unchanged subterms are shared.
  * Example: (Var v).subs (v -> (Var s)) = (Var s)
  */
+TermId substitute(Env *env, TermId original, const MatchContext &context);
+
+// RuleTree overload of substitute. Returns a deep copy owned by the caller.
 RuleTree *substitute(Env *env, RuleTree *original, map<string, RuleTree*> substitutions);
 
+/**
+ * @brief Checks if one rule generalizes to another without throwing. Used by the search loop.
+ * 
+ * @param env The environment to run in.
+ * @param general The more general rule.
+ * @param specific The more specific rule.
+ * @param context The bindings made so far. New bindings are added in place
+ * (and may be partially added if the match fails).
+ * @return MATCH_OK on success, otherwise the reason no generalization is possible.
+ */
+MatchStatus match(Env *env, TermId general, TermId specific, MatchContext &context);
+
 /**
  * @brief Checks if one rule generalizes to another.
  * 
  * @param env The environment to run in.
  * @param general The more general rule.
- * @param substitutions The substitutions made so far.
- * @return map<string, RuleTree*> The new map of substitutions.
+ * @param context The bindings made so far.
+ * @return MatchContext The bindings with the new ones added.
  * @throws an error (string) if no generalization is possible.
  */
+MatchContext generalize(Env *env, TermId general, TermId specific, MatchContext context);
+
+// RuleTree overload of generalize. The returned substitutions point into specific (or the given substitutions).
 map<string, RuleTree*> generalize(Env *env, RuleTree *general, RuleTree *specific, map<string, RuleTree*> substitutions);
\ No newline at end of file
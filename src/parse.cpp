@@ -1,30 +1,60 @@
 #include "data/globals.h"
 #include "data/rule.h"
+#include "data/snapshot.h"
+#include "data/typeUnifier.h"
 #include "data/utils.h"
+#include "logic.h"
 #include "parse.h"
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fcntl.h>
 #include <iostream>
 #include <sstream>
 #include <map>
+#include <stdexcept>
+#include <pthread.h>
 #include <set>
 #include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
+using std::atomic;
 using std::endl;
-using std::getline;
-using std::ifstream;
 using std::map;
+using std::min;
+using std::pair;
 using std::ostringstream;
+using std::out_of_range;
 using std::set;
 using std::string;
+using std::string_view;
+using std::unordered_map;
 using std::vector;
 
 using namespace rules;
 
+// Read the count given to a statement, throwing its usage message if it isn't a number that fits.
+static size_t parseCount(const string &digits, const char *usage) {
+    if (digits.empty() || !isInt(digits)) throw usage;
+
+    try {
+        return stoul(digits);
+    } catch (const out_of_range&) {
+        throw usage;
+    }
+}
+
 string parseStatement(string command, Env *env) {
     // Find the first keyword.
     int first_space = charPos(command, ' ', 1);
+
+    delete env -> ask_rule;
     env -> ask_rule = nullptr;
 
     ostringstream out = ostringstream();
@@ -40,6 +70,20 @@ string parseStatement(string command, Env *env) {
         return out.str();
     }
 
+    // Forward chain from the rules, optionally with a limit on the number of facts
+    if (first_word == "saturate") {
+        size_t max_facts = 1000;
+
+        if (first_space != -1) {
+            max_facts = parseCount(command.substr(first_space + 1), "ParseException: Expected saturate [max_facts].");
+        }
+
+        size_t total = saturate(env, max_facts);
+
+        out << "Saturated with " << total << " facts." << endl;
+        return out.str();
+    }
+
     if (first_space == -1) {
         return "\n";
     }
@@ -47,6 +91,57 @@ string parseStatement(string command, Env *env) {
     // If we have an ask, check for validity then return it
     if (first_word == "ask") {
         string remainder = command.substr(first_space + 1);
+
+        // An optional search mode keyword may come before the rule
+        int mode_space = charPos(remainder, ' ', 1);
+        auto mode = search_modes.find(remainder.substr(0, mode_space));
+
+        env -> ask_search = env -> default_search;
+        env -> ask_heuristic = env -> default_heuristic;
+        env -> ask_more = 0;
+
+        // Continue the last ask from where it ran out of depth, searching the given number of levels more
+        if (remainder.substr(0, mode_space) == "more") {
+            string levels = mode_space == -1 ? "" : remainder.substr(mode_space + 1);
+            size_t more = parseCount(levels, "ParseException: Expected ask more <levels>.");
+
+            if (more == 0) {
+                throw "ParseException: Expected ask more <levels>.";
+            }
+
+            if (env -> frontier -> empty()) {
+                throw "IllegalArgumentException: The last ask did not run out of depth, so there is nothing to continue";
+            }
+
+            env -> ask_more = more;
+            env -> ask_search = env -> frontier -> search;
+            env -> ask_heuristic = env -> frontier -> heuristic;
+            env -> ask_rule = env -> toRuleTree(env -> frontier -> ask);
+
+            out << "Asking " << *env -> ask_rule << " for " << levels << " more levels" << endl;
+            return out.str();
+        }
+
+        if (mode != search_modes.end()) {
+            if (mode_space == -1) throw "ParseException: Missing rule after search mode.";
+
+            env -> ask_search = mode -> second;
+            remainder = remainder.substr(mode_space + 1);
+
+            // Best first search must name its heuristic
+            if (mode -> second == SEARCH_BEST_FIRST) {
+                int heuristic_space = charPos(remainder, ' ', 1);
+                auto heuristic = heuristics.find(remainder.substr(0, heuristic_space));
+
+                if (heuristic == heuristics.end() || heuristic_space == -1) {
+                    throw "ParseException: Expected ask best <size|overlap|history> <rule>.";
+                }
+
+                env -> ask_heuristic = heuristic -> second;
+                remainder = remainder.substr(heuristic_space + 1);
+            }
+        }
+
         RuleTree *ask_rule = parseRule(remainder, env);
 
         typeCheck(ask_rule, env, map<string, string>());
@@ -64,22 +159,24 @@ string parseStatement(string command, Env *env) {
     // Source the code from a file
     if (first_word == "source") {
         string remainder = command.substr(first_space + 1);
+        return sourceFile(remainder, env);
+    }
 
-        ifstream f;
-        f.open(remainder);
+    // Write the declarations and rules to a snapshot, which load reads back without parsing
+    if (first_word == "save") {
+        string remainder = command.substr(first_space + 1);
+        size_t saved = saveSnapshot(env, remainder);
 
-        if (!f.is_open()) {
-            throw "FileNotFoundException: Please check the file exists.";
-        }
+        out << "Saved " << saved << " rules to " << remainder << endl;
+        return out.str();
+    }
 
-        string line;
-        ostringstream output;
-        while (!f.eof()) {
-            getline(f, line);
-            output << parseStatement(line, env);
-        }
+    if (first_word == "load") {
+        string remainder = command.substr(first_space + 1);
+        size_t loaded = loadSnapshot(env, remainder);
 
-        return output.str();
+        out << "Loaded " << loaded << " rules from " << remainder << endl;
+        return out.str();
     }
 
     if (first_word == "declare") {
@@ -143,6 +240,29 @@ string parseStatement(string command, Env *env) {
             return out.str();
         }
 
+        // ConjunctionDeclare
+        if (second_word == "conjunction") {
+            auto op = env -> operators.find(remainder);
+
+            if (op == env -> operators.end()) {
+                throw "IllegalArgumentException: Conjunctions must be declared operators";
+            }
+
+            // Only a goal whose sides are all goals themselves can be proven one side at a time
+            if (op -> second.size() < 3) {
+                throw "IllegalArgumentException: Conjunctions must take at least two arguments";
+            }
+
+            for (string type : op -> second) {
+                if (type != "Bool") throw "IllegalArgumentException: Conjunctions must be of type Bool, with Bool arguments";
+            }
+
+            env -> addConjunction(remainder);
+
+            out << "Added Conjunction " << remainder << endl;
+            return out.str();
+        }
+
         // RuleDeclare
         if (second_word == "rule") {
             RuleTree *rule = parseRule(remainder, env);
@@ -153,7 +273,7 @@ string parseStatement(string command, Env *env) {
                 throw "IllegalArgumentException: Declared rules must be of type Bool";
             }
 
-            env -> rules.insert(rule);
+            env -> addRule(rule);
 
             out << "Added Rule " << *rule << endl;
             return out.str();
@@ -164,116 +284,485 @@ string parseStatement(string command, Env *env) {
 
 }
 
-RuleTree *parseRule(string command, Env *env) {
-    map<string, string> variables = env -> variables;
-    set<string> type_vars = env -> type_vars;
+// A `declare rule` line of a sourced file, parsed and type checked by one of the loader threads.
+struct SourceRule {
+    size_t line;
+    string_view text;
 
-    map<string, vector<string>> op_names = env -> operators;
-    set<string> type_names = env -> type_names;
+    RuleTree *rule = nullptr;
+    const char *error = nullptr;
+};
 
-    vector<string> command_parts = splitCommand(command);
-    map<string, string> literals = env -> literals;
+// Shared by the loader threads. Each takes the next chunk of rules until none are left.
+struct SourceLoad {
+    Env *env;
+    vector<SourceRule> *rules;
+    atomic<size_t> next;
+};
 
-    if (command_parts.empty()) {
-        throw "ParseException: Empty input is invalid";
+// Rules are handed out this many at a time, and a file needs this many rules per extra thread.
+static const size_t SOURCE_CHUNK_SIZE = 64;
+
+static void *loadSourceRules(void *arg) {
+    SourceLoad *load = (SourceLoad*) arg;
+    vector<SourceRule> &rules = *load -> rules;
+
+    for (size_t start = load -> next.fetch_add(SOURCE_CHUNK_SIZE); start < rules.size(); start = load -> next.fetch_add(SOURCE_CHUNK_SIZE)) {
+        for (size_t i = start; i < rules.size() && i < start + SOURCE_CHUNK_SIZE; i++) {
+            // Parsing and type checking only read the env, so any number of threads can do it at once.
+            try {
+                RuleTree *rule = parseRule(string(rules[i].text), load -> env);
+                rules[i].rule = rule;
+
+                typeCheck(rule, load -> env, map<string, string>());
+
+                if (rule -> rule_type != "Bool") {
+                    throw "IllegalArgumentException: Declared rules must be of type Bool";
+                }
+            } catch (const char *e) {
+                delete rules[i].rule;
+                rules[i].rule = nullptr;
+                rules[i].error = e;
+            }
+        }
     }
 
-    RuleTree *current = new RuleTree();
+    return nullptr;
+}
 
-    // Assume a rule is of the form (op a b ...) like how Haskell functions are applied
+// A name a line of a sourced file declares, so it can be taken back if a rule above it fails.
+struct SourceDeclaration {
+    size_t line;
+    string kind;
+    string name;
+};
 
-    // If this is an operator, split and recurse.
-    if (default_operators.find(command_parts[0]) != default_operators.end() ||
-    op_names.find(command_parts[0]) != op_names.end()) {
-        current -> rule_op = command_parts[0];
+// The name a declaration line declares, or "" if it isn't one that adds a name.
+static string declaredName(string_view line) {
+    if (line.substr(0, 8) != "declare ") return "";
 
-        vector<string> op_params;
-        if (default_operators.find(command_parts[0]) != default_operators.end()) {
-            op_params = default_operators[command_parts[0]];
-        } else {
-            op_params = op_names[command_parts[0]];
-        } 
+    size_t kind_end = line.find(' ', 8);
+    if (kind_end == string_view::npos) return "";
 
-        // Check that the function argument count is correct
-        if (op_params.size() != command_parts.size()) {
-            delete current;
-            throw "IllegalArgumentException: Invalid number of arguments passed to function";
+    string_view kind = line.substr(8, kind_end - 8);
+    string remainder = string(line.substr(kind_end + 1));
+
+    if (kind == "type" || kind == "typevar") return remainder;
+    if (kind != "var" && kind != "literal" && kind != "operator") return "";
+
+    try {
+        vector<string> parts = splitCommand(remainder);
+        return parts.empty() ? "" : parts[0];
+    } catch (const char*) {
+        return "";
+    }
+}
+
+// Check whether a rule line uses a name that a line below it declares. Running the lines one at a time,
+// such a rule fails, so the file can't be loaded with every declaration made up front.
+static bool usesLaterName(string_view rule, size_t line, const unordered_map<string_view, size_t> &declared_at) {
+    size_t i = 0;
+    while (i < rule.length()) {
+        if (rule[i] == ' ' || rule[i] == '(' || rule[i] == ')') {
+            i ++;
+            continue;
         }
 
-        current -> rule_type = op_params[0];
+        size_t start = i;
+        while (i < rule.length() && rule[i] != ' ' && rule[i] != '(' && rule[i] != ')') i ++;
 
-        for (size_t i = 1; i < command_parts.size(); i++) {
-            string next_command = command_parts[i];
+        auto found = declared_at.find(rule.substr(start, i - start));
+        if (found != declared_at.end() && found -> second > line) return true;
+    }
 
-            // Remove grouping if needed
-            if (next_command[0] == '(') {
-                next_command = next_command.substr(1, next_command.length() - 2);
-            }
+    return false;
+}
+
+// Take back a declaration made while loading a file.
+static void undeclare(const SourceDeclaration &declaration, Env *env) {
+    if (declaration.kind == "type") env -> type_names.erase(declaration.name);
+    if (declaration.kind == "typevar") env -> type_vars.erase(declaration.name);
+    if (declaration.kind == "var") env -> variables.erase(declaration.name);
+    if (declaration.kind == "literal") env -> literals.erase(declaration.name);
+    if (declaration.kind == "operator") env -> operators.erase(declaration.name);
+    if (declaration.kind == "conjunction") env -> conjunctions.erase(declaration.name);
+}
+
+// Run the lines of a file one at a time.
+static string runLines(const vector<string_view> &lines, Env *env) {
+    ostringstream out = ostringstream();
+    for (string_view line : lines) {
+        out << parseStatement(string(line), env);
+    }
+
+    return out.str();
+}
 
-            current -> sub_rules.push_back(
-                parseRule(next_command, env)
-            );
+// Load a file made only of declarations. Everything but the rules is declared first, in order,
+// then the rules are parsed on all cores and added in order.
+// The output and the env afterwards are the same as running each line, even when a line fails.
+static string loadDeclarations(const vector<string_view> &lines, Env *env) {
+    // The first line declaring each name. Lines that fail only make this find more rules to check.
+    unordered_map<string_view, size_t> declared_at = unordered_map<string_view, size_t>();
+    vector<string> names = vector<string>(lines.size());
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        names[i] = declaredName(lines[i]);
+        if (!names[i].empty()) declared_at.insert({names[i], i});
+    }
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (lines[i].substr(0, 13) == "declare rule " && usesLaterName(lines[i].substr(13), i, declared_at)) {
+            return runLines(lines, env);
         }
     }
 
-    // If no operator was found, check this is a variable of some kind and store it.
-    else {
-        // Check that there's only a single extra command_part, with no grouping.
-        if (command_parts.size() != 1) {
-            delete current;
-            throw "ParseException: Single values must be a single value";
-        } else if (command_parts[0][0] == '(') {
-            delete current;
-            throw "ParseException: Single values may not contain grouping";
+    vector<string> outputs = vector<string>(lines.size());
+    vector<SourceRule> rules = vector<SourceRule>();
+    vector<SourceDeclaration> declared = vector<SourceDeclaration>();
+
+    // Stop at the first declaration that fails. Only the rules above it are added, like running the lines would.
+    size_t end = lines.size();
+    const char *error = nullptr;
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (lines[i].substr(0, 13) == "declare rule ") {
+            SourceRule rule = SourceRule();
+            rule.line = i;
+            rule.text = lines[i].substr(13);
+            rules.push_back(rule);
+            continue;
         }
 
-        // Check whether this is a boolean.
-        if (command_parts[0] == "true" || command_parts[0] == "false") {
-            current -> rule_type = "Bool";
-            current -> rule_value = command_parts[0];
-            return current;            
+        SourceDeclaration declaration = SourceDeclaration();
+        declaration.line = i;
+        declaration.name = names[i];
+
+        if (lines[i].substr(0, 20) == "declare conjunction ") {
+            declaration.name = string(lines[i].substr(20));
+
+            // Declaring a conjunction again changes nothing, so there is nothing to take back.
+            if (env -> conjunctions.find(declaration.name) == env -> conjunctions.end()) declaration.kind = "conjunction";
+        } else if (!declaration.name.empty()) {
+            declaration.kind = string(lines[i].substr(8, lines[i].find(' ', 8) - 8));
         }
 
-        // Check whether this is an int.
-        if (isInt(command_parts[0])) {
-            current -> rule_type = "Int";
-            current -> rule_value = command_parts[0];
-            return current;               
+        try {
+            outputs[i] = parseStatement(string(lines[i]), env);
+        } catch (const char *e) {
+            end = i;
+            error = e;
+            break;
         }
 
-        // Check whether this is a float.
-        if (isFloat(command_parts[0])) {
-            current -> rule_type = "Float";
-            current -> rule_value = command_parts[0];
-            return current;               
+        if (!declaration.kind.empty()) declared.push_back(declaration);
+    }
+
+    // Rules below a failed declaration are never added, so don't parse them.
+    while (!rules.empty() && rules.back().line > end) rules.pop_back();
+
+    SourceLoad load = SourceLoad();
+    load.env = env;
+    load.rules = &rules;
+    load.next = 0;
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = min((size_t) (cores > 0 ? cores : 1), (rules.size() + SOURCE_CHUNK_SIZE - 1) / SOURCE_CHUNK_SIZE);
+
+    // This thread loads rules too, so it only starts the others.
+    vector<pthread_t> threads = vector<pthread_t>();
+    for (size_t i = 1; i < thread_count; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, loadSourceRules, &load) == 0) threads.push_back(thread);
+    }
+
+    loadSourceRules(&load);
+
+    for (pthread_t thread : threads) {
+        pthread_join(thread, NULL);
+    }
+
+    // Add the rules in file order, up to the first one that failed.
+    for (size_t i = 0; i < rules.size(); i++) {
+        if (rules[i].error) {
+            for (size_t j = i; j < rules.size(); j++) delete rules[j].rule;
+
+            // The lines below the failed rule would never have run, so take back what they declared.
+            for (size_t j = declared.size(); j > 0 && declared[j - 1].line > rules[i].line; j--) {
+                undeclare(declared[j - 1], env);
+            }
+
+            error = rules[i].error;
+            break;
         }
 
-        // Check for valid variable/TypeVar/TypeName name.
-        if (variables.find(command_parts[0]) != variables.end()) {
-            current -> rule_type = variables[command_parts[0]];
-            current -> rule_value = command_parts[0];
-            return current;
-        } else if (type_vars.find(command_parts[0]) != type_vars.end()) {
-            current -> rule_type = "TypeVar";
-            current -> rule_value = command_parts[0];
-            return current;
-        } else if (type_names.find(command_parts[0]) != type_names.end()) {
-            current -> rule_type = "TypeName";
-            current -> rule_value = command_parts[0];
-            return current;
-        } else if (literals.find(command_parts[0]) != literals.end()) {
-            current -> rule_type = literals[command_parts[0]];
-            current -> rule_value = command_parts[0];
-            return current;
+        env -> addRule(rules[i].rule);
+
+        ostringstream out = ostringstream();
+        out << "Added Rule " << *rules[i].rule << endl;
+        outputs[rules[i].line] = out.str();
+    }
+
+    if (error) throw error;
+
+    ostringstream output = ostringstream();
+    for (const string &out : outputs) {
+        output << out;
+    }
+
+    return output.str();
+}
+
+// Source a file of declarations. A file with the same contents already loaded into the env
+// declared everything this one would, so it isn't run again (and nothing is announced as added).
+static string sourceDeclarations(const string &path, string_view text, const vector<string_view> &lines, Env *env) {
+    if (env -> sources -> loaded(text)) return "Already sourced " + path + "\n";
+
+    string output = loadDeclarations(lines, env);
+    env -> sources -> add(text);
+    return output;
+}
+
+string sourceFile(string path, Env *env) {
+    int fd = open(path.c_str(), O_RDONLY);
+
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) == -1 || !S_ISREG(info.st_mode)) {
+        if (fd != -1) close(fd);
+        throw "FileNotFoundException: Please check the file exists.";
+    }
+
+    // An empty file can't be mapped, but it is still read as a single empty line.
+    void *data = nullptr;
+    if (info.st_size > 0) {
+        data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        throw "FileNotFoundException: Could not read the file.";
+    }
+
+    string_view text = string_view((const char*) data, data ? info.st_size : 0);
+
+    // Split on newlines. Like getline, a trailing newline gives a last empty line.
+    vector<string_view> lines = vector<string_view>();
+    bool declarations_only = true;
+
+    size_t start = 0;
+    while (true) {
+        size_t newline = text.find('\n', start);
+        string_view line = text.substr(start, newline == string_view::npos ? string_view::npos : newline - start);
+
+        lines.push_back(line);
+        if (!line.empty() && line.substr(0, 8) != "declare ") declarations_only = false;
+
+        if (newline == string_view::npos) break;
+        start = newline + 1;
+    }
+
+    // Files are told apart by their canonical path, so a cycle is found however the paths are written.
+    char *canonical = realpath(path.c_str(), nullptr);
+    string file = canonical ? string(canonical) : path;
+    free(canonical);
+
+    bool entered = false;
+
+    try {
+        env -> sources -> enter(file);
+        entered = true;
+
+        string output;
+
+        if (declarations_only) {
+            output = sourceDeclarations(path, text, lines, env);
+        } else {
+            // Other commands (like ask) need everything above them, so run the lines one at a time.
+            output = runLines(lines, env);
+        }
+
+        env -> sources -> leave();
+        if (data) munmap(data, info.st_size);
+        return output;
+    } catch (...) {
+        if (entered) env -> sources -> leave();
+        if (data) munmap(data, info.st_size);
+        throw;
+    }
+}
+
+// The tokens of a rule, in order. Parentheses are tokens of their own, and each ( stores
+// the index of its matching ), so a level can be walked without scanning its groups again.
+struct RuleTokens {
+    vector<string_view> text;
+    vector<size_t> close;
+};
+
+static bool isRuleGroup(const RuleTokens &tokens, size_t i) {
+    return tokens.text[i][0] == '(';
+}
+
+// The index of the token after the value starting at i (skipping the whole group, if it is one).
+static size_t nextRuleToken(const RuleTokens &tokens, size_t i) {
+    return isRuleGroup(tokens, i) ? tokens.close[i] + 1 : i + 1;
+}
+
+// Split a rule into tokens in a single pass, checking the grouping as it goes.
+// Views point into command, so it must outlive the tokens.
+static RuleTokens tokenizeRule(string_view command) {
+    RuleTokens tokens = RuleTokens();
+    vector<size_t> open = vector<size_t>();
+
+    size_t i = 0;
+    while (i < command.length()) {
+        switch (command[i]) {
+            case ' ':
+                i ++;
+                break;
+            case '(':
+                // A ( must start a value, right after whitespace or another (.
+                if (i > 0 && command[i - 1] != ' ' && command[i - 1] != '(') {
+                    throw "ParseException: Parentheses must be separated by whitespace";
+                }
+
+                open.push_back(tokens.text.size());
+                tokens.text.push_back(command.substr(i, 1));
+                tokens.close.push_back(0);
+                i ++;
+                break;
+            case ')':
+                if (open.empty()) {
+                    throw "ParseException: No ( found to match this )";
+                }
+
+                // A ) must end a value, right before whitespace or another ).
+                if (i + 1 < command.length() && command[i + 1] != ' ' && command[i + 1] != ')') {
+                    throw "ParseException: Parentheses must be separated by whitespace";
+                }
+
+                tokens.close[open.back()] = tokens.text.size();
+                open.pop_back();
+                tokens.text.push_back(command.substr(i, 1));
+                tokens.close.push_back(0);
+                i ++;
+                break;
+            default:
+                size_t start = i;
+                while (i < command.length() && command[i] != ' ' && command[i] != '(' && command[i] != ')') i ++;
+
+                tokens.text.push_back(command.substr(start, i - start));
+                tokens.close.push_back(0);
+        }
+    }
+
+    if (!open.empty()) {
+        throw "ParseException: No ) found to match this (";
+    }
+
+    return tokens;
+}
+
+// Parse the tokens in [begin, end) into a tree. These are the contents of one level of grouping.
+// Every token is looked at once per level it sits directly in, so a rule parses in linear time.
+static RuleTree *parseRuleTokens(const RuleTokens &tokens, size_t begin, size_t end, Env *env) {
+    if (begin == end) {
+        throw "ParseException: Empty input is invalid";
+    }
+
+    size_t part_count = 0;
+    for (size_t i = begin; i < end; i = nextRuleToken(tokens, i)) part_count ++;
+
+    bool grouped = isRuleGroup(tokens, begin);
+    string first = string(tokens.text[begin]);
+
+    // Assume a rule is of the form (op a b ...) like how Haskell functions are applied
+
+    // If this is an operator, recurse on each argument.
+    auto default_op = grouped ? default_operators.end() : default_operators.find(first);
+    auto user_op = grouped ? env -> operators.end() : env -> operators.find(first);
+    if (default_op != default_operators.end() || user_op != env -> operators.end()) {
+        const vector<string> &op_params = default_op != default_operators.end() ? default_op -> second : user_op -> second;
+
+        // Check that the function argument count is correct
+        if (op_params.size() != part_count) {
+            throw "IllegalArgumentException: Invalid number of arguments passed to function";
+        }
+
+        RuleTree *current = new RuleTree();
+        current -> rule_op = first;
+        current -> rule_type = op_params[0];
+
+        try {
+            for (size_t i = nextRuleToken(tokens, begin); i < end; i = nextRuleToken(tokens, i)) {
+                // Groups are parsed without their parentheses.
+                if (isRuleGroup(tokens, i)) {
+                    current -> sub_rules.push_back(parseRuleTokens(tokens, i + 1, tokens.close[i], env));
+                } else {
+                    current -> sub_rules.push_back(parseRuleTokens(tokens, i, i + 1, env));
+                }
+            }
+        } catch (...) {
+            delete current;
+            throw;
         }
 
-        delete current;
-        throw "ParseException: Undefined non-literal input" ;
+        return current;
+    }
+
+    // If no operator was found, check this is a variable of some kind and store it.
+    // Check that there's only a single token, with no grouping.
+    if (part_count != 1) {
+        throw "ParseException: Single values must be a single value";
+    } else if (grouped) {
+        throw "ParseException: Single values may not contain grouping";
+    }
 
+    RuleTree *current = new RuleTree();
+    current -> rule_value = first;
+
+    // Check whether this is a boolean.
+    if (first == "true" || first == "false") {
+        current -> rule_type = "Bool";
+        return current;
     }
 
-    return current;
+    // Check whether this is an int.
+    if (isInt(first)) {
+        current -> rule_type = "Int";
+        return current;
+    }
 
+    // Check whether this is a float.
+    if (isFloat(first)) {
+        current -> rule_type = "Float";
+        return current;
+    }
+
+    // Check for valid variable/TypeVar/TypeName name.
+    auto variable = env -> variables.find(first);
+    auto literal = env -> literals.find(first);
+    if (variable != env -> variables.end()) {
+        current -> rule_type = variable -> second;
+        return current;
+    } else if (env -> type_vars.find(first) != env -> type_vars.end()) {
+        current -> rule_type = "TypeVar";
+        return current;
+    } else if (env -> type_names.find(first) != env -> type_names.end()) {
+        current -> rule_type = "TypeName";
+        return current;
+    } else if (literal != env -> literals.end()) {
+        current -> rule_type = literal -> second;
+        return current;
+    }
+
+    delete current;
+    throw "ParseException: Undefined non-literal input" ;
+}
+
+RuleTree *parseRule(string command, Env *env) {
+    RuleTokens tokens = tokenizeRule(command);
+    return parseRuleTokens(tokens, 0, tokens.text.size(), env);
 }
 
 pair<string, string> parseVarDeclare(string command, Env *env) {
@@ -337,55 +826,84 @@ pair<string, vector<string>> parseOpDeclare(string command, Env *env) {
 
 }
 
-map<string, string> typeCheck(RuleTree *rule, Env *env, map<string, string> bound_types) {
-    // If no operator, return
+// The type inferred for a node so far: a concrete type name, or a TypeVar's class in the unifier.
+// Values always have concrete types. Their declared type may be a TypeVar name, which can't be narrowed.
+struct InferredType {
+    string name;
+    size_t var = NO_TYPE_VAR;
+};
+
+// Unify the types below rule with the operators' signatures, in place.
+// Operators with a TypeVar result are listed in open, so their types can be filled in once everything is unified.
+static InferredType inferTypes(RuleTree *rule, Env *env, TypeUnifier<string> &unifier, vector<pair<RuleTree*, size_t>> &open) {
+    InferredType type = InferredType();
+
+    // If no operator, the value's type is already known
     if (rule -> rule_value != "") {
-        return bound_types;
+        type.name = rule -> rule_type;
+        return type;
     }
 
-    vector<string> cur_types;
-
-    if (env -> operators.find(rule -> rule_op) != env -> operators.end()) {
-        cur_types = env -> operators[rule -> rule_op];
-    } else cur_types = default_operators[rule -> rule_op];
+    // Only look the operator up (no operator[]), since rules may be type checked on several threads at once.
+    auto user_op = env -> operators.find(rule -> rule_op);
+    const vector<string> &cur_types = user_op != env -> operators.end() ? user_op -> second : default_operators.at(rule -> rule_op);
 
     // Recursive Case: Type Check subrules
     for (size_t i = 0; i < rule -> sub_rules.size(); i++) {
-        RuleTree *child = rule -> sub_rules[i];
-        bound_types = typeCheck(child, env, bound_types);
-
-        string cur_type = cur_types[i + 1];
+        InferredType child = inferTypes(rule -> sub_rules[i], env, unifier, open);
+        const string &cur_type = cur_types[i + 1];
 
         bool is_valid = false;
 
-        // Expected Type = Actual Type
-        if (child -> rule_type == cur_type) is_valid = true;
-
         // Expected Type = _ (match anything)
         if (cur_type == "_") is_valid = true;
 
-        // Type is a TypeVar.
-        if (env -> type_vars.find(cur_type) != env -> type_vars.end()) {
-            // If unbound, add to map. If bound, check valid.
-            if (bound_types.find(cur_type) == bound_types.end()) {
-                bound_types[cur_type] = child -> rule_type;
-                is_valid = true;
-            } else if (bound_types[cur_type] == child -> rule_type) {
-                is_valid = true;
-            }
+        // Expected Type is a TypeVar: unify it with the actual type.
+        else if (env -> type_vars.find(cur_type) != env -> type_vars.end()) {
+            size_t var = unifier.variable(cur_type);
+            is_valid = child.var != NO_TYPE_VAR ? unifier.unify(var, child.var) : unifier.bind(var, child.name);
         }
-        
+
+        // Expected Type = Actual Type (an unresolved TypeVar result takes on the expected type)
+        else {
+            is_valid = child.var != NO_TYPE_VAR ? unifier.bind(child.var, cur_type) : child.name == cur_type;
+        }
+
         if (!is_valid) {
             throw "IllegalArgumentException: Type matching failed.";
         }
+    }
 
+    type.name = cur_types[0];
+    rule -> rule_type = cur_types[0];
 
+    if (env -> type_vars.find(cur_types[0]) != env -> type_vars.end()) {
+        type.var = unifier.variable(cur_types[0]);
+        open.push_back({rule, type.var});
     }
 
-    if (bound_types.find(cur_types[0]) != bound_types.end()) {
-        rule -> rule_type = bound_types[cur_types[0]];
-    } else {
-        rule -> rule_type = cur_types[0];
+    return type;
+}
+
+map<string, string> typeCheck(RuleTree *rule, Env *env, map<string, string> bound_types) {
+    TypeUnifier<string> unifier = TypeUnifier<string>();
+
+    for (auto &bound : bound_types) {
+        unifier.bind(unifier.variable(bound.first), bound.second);
+    }
+
+    vector<pair<RuleTree*, size_t>> open = vector<pair<RuleTree*, size_t>>();
+    inferTypes(rule, env, unifier, open);
+
+    // Operators whose TypeVar was bound get the bound type. Free ones keep the TypeVar's name.
+    for (auto &node : open) {
+        const string *bound = unifier.binding(node.second);
+        if (bound) node.first -> rule_type = *bound;
+    }
+
+    for (size_t var = 0; var < unifier.size(); var++) {
+        const string *bound = unifier.binding(var);
+        if (bound) bound_types[unifier.name(var)] = *bound;
     }
 
     return bound_types;
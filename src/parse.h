@@ -26,6 +26,18 @@ string parseStatement(string command, Env *env);
 
 // Helper Functions and Methods
 
+/**
+ * @brief Run every line of a file as a statement, and return all their output.
+ * A file made only of declarations is loaded in bulk: the other declarations are made first,
+ * then the rules are parsed and type checked on all cores, and added in file order.
+ * 
+ * @param path The file to source. Lines are split on LF.
+ * @param env The environment to run the statements in.
+ * @return string The output of every line, in order.
+ * @throws FileNotFoundException when the file can't be read, or whatever the first failing line throws
+ */
+string sourceFile(string path, Env *env);
+
 /**
  * @brief Parse a partial rule into a tree.
  * 
@@ -64,6 +76,7 @@ pair<string, vector<string>> parseOpDeclare(string command, Env *env);
 
 /**
  * @brief Type check a rule.
+ * TypeVars are unified in place (see TypeUnifier), so this is linear in the size of the rule.
  * 
  * @param rule The rule to check.
  * @param env The env to check with.
@@ -95,4 +108,3 @@ vector<string> splitCommand(string command);
  * or -1 if the character wasn't found.
  */
 int charPos(string to_test, char to_find, size_t num_occurrences);
-
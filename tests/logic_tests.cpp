@@ -352,6 +352,70 @@ TEST_CASE("Invalid operator, can't apply", "[generalize]") {
     delete apply;
 }
 
+TEST_CASE("Match context: TypeVar bindings are local to each match", "[match]") {
+    Env *env = setupEnv();
+    RuleTree *general = parseRule("IsInt d", env);
+    RuleTree *as_int = parseRule("IsInt Zero", env);
+    RuleTree *as_bool = parseRule("IsInt true", env);
+
+    MatchContext first;
+    MatchContext second;
+
+    // The same TypeVar binds differently in two matches, since nothing is kept in the env
+    REQUIRE(match(env, env -> intern(general), env -> intern(as_int), first) == MATCH_OK);
+    REQUIRE(match(env, env -> intern(general), env -> intern(as_bool), second) == MATCH_OK);
+
+    REQUIRE(*first.type_vars.lookup(env -> symbol("Type")) == env -> symbol("Int"));
+    REQUIRE(*second.type_vars.lookup(env -> symbol("Type")) == env -> symbol("Bool"));
+
+    // Substituting with a context applies its bindings
+    REQUIRE(substitute(env, env -> intern(general), first) == env -> intern(as_int));
+
+    delete env;
+    delete general;
+    delete as_int;
+    delete as_bool;
+}
+
+TEST_CASE("Match status: failures are reported without throwing", "[match]") {
+    Env *env = setupEnv();
+    RuleTree *specific = parseRule("--> false true", env);
+    RuleTree *general = parseRule("--<> true true", env);
+    RuleTree *victim = parseRule("IsInt (+ c 1)", env);
+    RuleTree *apply = parseRule("--> (IsInt a) (IsInt (+ a 1))", env);
+
+    MatchContext context;
+    TermId result = NO_TERM;
+
+    REQUIRE(match(env, env -> intern(general), env -> intern(specific), context) == MATCH_OPERATOR_MISMATCH);
+    REQUIRE(tryApplyRule(env, env -> intern(apply), env -> intern(victim), false, result) == MATCH_WRONG_DIRECTION);
+    REQUIRE(result == NO_TERM);
+    REQUIRE(string(matchError(MATCH_WRONG_DIRECTION)) == "GeneralizeError: Can only apply rules with --> or --<> (or incorrect direction)");
+
+    delete env;
+    delete specific;
+    delete general;
+    delete victim;
+    delete apply;
+}
+
+TEST_CASE("Match status: successful application", "[match]") {
+    Env *env = setupEnv();
+    RuleTree *victim = parseRule("IsInt (+ c 1)", env);
+    RuleTree *apply = parseRule("--> (IsInt a) (IsInt (+ a 1))", env);
+    RuleTree *expected = parseRule("IsInt c", env);
+
+    TermId result = NO_TERM;
+
+    REQUIRE(tryApplyRule(env, env -> intern(apply), env -> intern(victim), true, result) == MATCH_OK);
+    REQUIRE(result == env -> intern(expected));
+
+    delete env;
+    delete victim;
+    delete apply;
+    delete expected;
+}
+
 TEST_CASE("Rule application: Integer Inclusion", "[generalize]") {
     Env *env = setupEnv();
     RuleTree *victim = parseRule("IsInt (+ c 1)", env);
@@ -379,20 +443,170 @@ Env *setupMathEnv() {
 TEST_CASE("Simple proof (2 in N)", "[runAskWorker]") {
     Env *env = setupMathEnv();
 
-    ProofTreeNode *root = new ProofTreeNode();
+    NodeArena arena;
+    ProofTreeNode *root = arena.make();
+
+    RuleTree *to_prove = parseRule("InNatural (S (S Zero))", env);
+    RuleTree *applied = parseRule("--<> (InNatural Two) (InNatural (S (S Zero)))", env);
+    root -> to_prove_remainder = env -> intern(to_prove);
+    root -> applied_rule = env -> intern(applied);
+
+    ProofTreeNode *leaf = runAskWorker(env, 5, root, &arena);
+
+    string proof = showProof(env, leaf);
+
+    REQUIRE(proof == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (S (Natural Zero))))\nApply rule (--<> (InNatural (Natural Two)) (InNatural (S (S (Natural Zero)))))\n\n");
+
+    delete to_prove;
+    delete applied;
+    delete env;
+}
+
+TEST_CASE("Proof finished with a lemma (2 in N)", "[runAskWorker]") {
+    Env *env = setupMathEnv();
+
+    RuleTree *to_prove = parseRule("InNatural (S (S Zero))", env);
+    RuleTree *zero = parseRule("InNatural Zero", env);
+    RuleTree *one = parseRule("InNatural (S Zero)", env);
+
+    // Too shallow to reach Zero on its own
+    NodeArena arena;
+    ProofTreeNode *root = arena.make();
+    root -> to_prove_remainder = env -> intern(to_prove);
+
+    REQUIRE_THROWS(runAskWorker(env, 2, root, &arena));
+
+    // An earlier proof of (S Zero) finishes it
+    Fact zero_lemma;
+    zero_lemma.term = env -> intern(zero);
+
+    Fact one_lemma;
+    one_lemma.term = env -> intern(one);
+    one_lemma.parent = env -> lemmas -> add(zero_lemma);
+    one_lemma.rule = env -> rule_terms[1];
+    env -> lemmas -> add(one_lemma);
+
+    // The first search marked its goals as visited
+    env -> visited -> clear();
+    arena.reset();
+    root = arena.make();
+    root -> to_prove_remainder = env -> intern(to_prove);
+
+    ProofTreeNode *leaf = runAskWorker(env, 2, root, &arena);
+
+    REQUIRE(showProof(env, leaf) == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n");
+
+    delete to_prove;
+    delete zero;
+    delete one;
+    delete env;
+}
+
+TEST_CASE("Simple proof with iterative deepening (2 in N)", "[runIddfsWorker]") {
+    Env *env = setupMathEnv();
+
+    NodeArena arena;
+    ProofTreeNode *root = arena.make();
 
     RuleTree *to_prove = parseRule("InNatural Two", env);
-    root -> to_prove_remainder = new RuleTree(*to_prove);
-    root -> applied_rule = parseRule("--<> (InNatural Two) (InNatural (S (S Zero)))", env);
+    root -> to_prove_remainder = env -> intern(to_prove);
 
-    ProofTreeNode *leaf = runAskWorker(env, 5, root);
+    ProofTreeNode *leaf = runIddfsWorker(env, 5, root, &arena);
 
-    string proof = showProof(leaf);
+    string proof = showProof(env, leaf);
 
     REQUIRE(proof == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (S (Natural Zero))))\nApply rule (--<> (InNatural (Natural Two)) (InNatural (S (S (Natural Zero)))))\n\n");
 
+    // Too shallow to reach Zero
+    NodeArena shallow_arena;
+    ProofTreeNode *shallow_root = shallow_arena.make();
+    shallow_root -> to_prove_remainder = env -> intern(to_prove);
+
+    REQUIRE_THROWS(runIddfsWorker(env, 2, shallow_root, &shallow_arena));
+
+    delete to_prove;
+    delete env;
+}
+
+TEST_CASE("Children are made one at a time", "[expandNode]") {
+    Env *env = setupMathEnv();
+
+    NodeArena arena;
+    RuleTree *to_prove = parseRule("InNatural (S (S Zero))", env);
+
+    ProofTreeNode *expanded = arena.make();
+    expanded -> to_prove_remainder = env -> intern(to_prove);
+    expandNode(expanded, env, &arena);
+
+    ProofTreeNode *root = arena.make();
+    root -> to_prove_remainder = env -> intern(to_prove);
+
+    // No rule is applied or node made until a child is asked for
+    ChildGenerator children(env, root);
+    size_t made = arena.size();
+
+    size_t count = 0;
+    for (ProofTreeNode *expected = expanded -> first_child; expected != nullptr; expected = expected -> next_sibling) {
+        ProofTreeNode *child = children.next(&arena);
+
+        REQUIRE(child != nullptr);
+        REQUIRE(arena.size() == made + 1);
+        REQUIRE(child -> parent == root);
+        REQUIRE(child -> to_prove_remainder == expected -> to_prove_remainder);
+        REQUIRE(child -> applied_rule == expected -> applied_rule);
+
+        made = arena.size();
+        count++;
+    }
+
+    REQUIRE(count > 0);
+    REQUIRE(children.next(&arena) == nullptr);
+    REQUIRE(arena.size() == made);
+    REQUIRE(root -> first_child == nullptr);
+
     delete to_prove;
-    delete root;
+    delete env;
+}
+
+TEST_CASE("Best first heuristics", "[heuristic]") {
+    Env *env = setupMathEnv();
+
+    RuleTree *goal = parseRule("InNatural (S Zero)", env);
+    ProofTreeNode node;
+    node.to_prove_remainder = env -> intern(goal);
+
+    // InNatural and Zero appear in the fact InNatural Zero, S doesn't
+    REQUIRE(sizeHeuristic(env, &node) == 3);
+    REQUIRE(overlapHeuristic(env, &node) == 1);
+
+    node.applied_rule = env -> rule_terms[1];
+    REQUIRE(historyHeuristic(env, &node) == 3);
+
+    env -> rule_successes[node.applied_rule] = 2;
+    REQUIRE(historyHeuristic(env, &node) == 1);
+
+    delete goal;
+    delete env;
+}
+
+TEST_CASE("Saturation derives facts forwards", "[saturate]") {
+    Env *env = setupMathEnv();
+
+    // InNatural Zero, then one more S per fact, until the limit
+    REQUIRE(saturate(env, 5) == 5);
+
+    RuleTree *three = parseRule("InNatural (S (S (S Zero)))", env);
+    RuleTree *two = parseRule("InNatural Two", env);
+
+    REQUIRE(env -> facts -> contains(env -> intern(three)));
+    REQUIRE(env -> facts -> contains(env -> intern(two)));
+
+    // Two was derived from S (S Zero) with the --<> rule
+    const Fact &fact = env -> facts -> get(env -> facts -> candidates(env -> intern(two))[0]);
+    REQUIRE(fact.rule == env -> rule_terms[2]);
+
+    delete three;
+    delete two;
     delete env;
 }
 
@@ -1,8 +1,10 @@
 #include "catch.hpp"
 
 #include "../src/data/rule.h"
+#include "../src/data/snapshot.h"
 #include "../src/parse.h"
 
+#include <fstream>
 #include <map>
 #include <set>
 #include <sstream>
@@ -343,6 +345,34 @@ TEST_CASE("Recursive Rule Parse", "[parseRule]") {
     delete env;
 }
 
+TEST_CASE("Deeply nested rule", "[parseRule]") {
+    string command = "1";
+    string expected = "(Int 1)";
+    for (size_t i = 0; i < 500; i++) {
+        command = "+ 1 (" + command + ")";
+        expected = "(+ (Int 1) " + expected + ")";
+    }
+
+    Env *env = setupEnv();
+
+    RuleTree *tree = parseRule(command, env);
+
+    ostringstream oss = ostringstream();
+    oss << *tree;
+    REQUIRE(oss.str() == expected);
+
+    delete tree;
+
+    // Grouping errors are found however deep they are.
+    REQUIRE_THROWS(parseRule(command + ")", env));
+    REQUIRE_THROWS(parseRule("(" + command, env));
+    REQUIRE_THROWS(parseRule("+ 1 (+ 1 (+ 1(2)))", env));
+    REQUIRE_THROWS(parseRule("+ 1 (+ 1 (+ (1)2 3))", env));
+    REQUIRE_THROWS(parseRule("+ 1 (+ 1 (+ ((1)) 2))", env));
+
+    delete env;
+}
+
 // VarDeclare tests
 TEST_CASE("Simple VarDeclare case (global variable name)", "[parseVarDeclare]") {
     string command = "Riley Int";
@@ -663,6 +693,64 @@ TEST_CASE("Type checking - Recursive (Valid)", "[typeCheck]") {
 
 }
 
+TEST_CASE("Type checking - TypeVar results are inferred", "[typeCheck]") {
+    Env *env = setup_type_env();
+    env -> operators["Id"] = {"NumType", "InputNumType"};
+
+    // Id's result is only known from where it is used
+    RuleTree *to_check = parseRule("] (Id 10) 3", env);
+
+    map<string, string> mappings = typeCheck(to_check, env, map<string, string>());
+
+    REQUIRE(to_check -> sub_rules[0] -> rule_type == "Int");
+    REQUIRE(mappings["NumType"] == "Int");
+    REQUIRE(mappings["InputNumType"] == "Int");
+
+    delete to_check;
+
+    // Nesting Id feeds NumType back into InputNumType, a cycle that is merged rather than rejected
+    to_check = parseRule("] (Id (Id 10)) 3", env);
+
+    mappings = typeCheck(to_check, env, map<string, string>());
+
+    REQUIRE(to_check -> sub_rules[0] -> rule_type == "Int");
+    REQUIRE(to_check -> sub_rules[0] -> sub_rules[0] -> rule_type == "Int");
+    REQUIRE(mappings["NumType"] == "Int");
+
+    delete to_check;
+
+    // Values typed with a TypeVar can't be narrowed
+    to_check = parseRule("+ OtherVar1 10", env);
+    REQUIRE_THROWS(typeCheck(to_check, env, map<string, string>()));
+
+    delete to_check;
+    delete env;
+}
+
+TEST_CASE("Type checking - Deep rule", "[typeCheck]") {
+    string command = "1";
+    for (size_t i = 0; i < 2000; i++) {
+        command = "+ 1 (" + command + ")";
+    }
+
+    Env *env = setup_type_env();
+
+    RuleTree *to_check = parseRule(command, env);
+
+    map<string, string> mappings = typeCheck(to_check, env, map<string, string>());
+    REQUIRE(mappings["NumType"] == "Int");
+
+    size_t typed = 0;
+    for (RuleTree *node = to_check; !node -> sub_rules.empty(); node = node -> sub_rules[1]) {
+        if (node -> rule_type == "Int") typed ++;
+    }
+
+    REQUIRE(typed == 2000);
+
+    delete to_check;
+    delete env;
+}
+
 // parseStatement tests
 TEST_CASE("Invalid statement", "[parseStatement]") {
     string command = "";
@@ -747,6 +835,24 @@ TEST_CASE("Declare Operator statement", "[parseStatement]") {
     delete env;
 }
 
+TEST_CASE("Declare Conjunction statement", "[parseStatement]") {
+    Env *env = new Env();
+    parseStatement("source tests/nat.rilab", env);
+
+    parseStatement("declare operator & Bool Bool Bool", env);
+    string output = parseStatement("declare conjunction &", env);
+
+    REQUIRE(output == "Added Conjunction &\n");
+    REQUIRE(env -> conjunctions.count("&") == 1);
+
+    // Only operators from goals to a goal can be split
+    REQUIRE_THROWS(parseStatement("declare conjunction |", env));
+    REQUIRE_THROWS(parseStatement("declare conjunction S", env));
+    REQUIRE_THROWS(parseStatement("declare conjunction InNatural", env));
+
+    delete env;
+}
+
 TEST_CASE("Declare Rule statement", "[parseStatement]") {
     string command = "declare rule [ (+ 1 2) (+ 2 1)";
     Env *env = setup_type_env();
@@ -780,4 +886,275 @@ TEST_CASE("Literal Rule statement", "[parseStatement]") {
     REQUIRE(output == "Added Rule ([ (Int Zero) (TypeVar NumType))\n");
 
     delete env;
+}
+
+TEST_CASE("Ask statement with a search mode", "[parseStatement]") {
+    Env *env = new Env();
+    parseStatement("source tests/nat.rilab", env);
+
+    string output = parseStatement("ask iddfs InNatural Two", env);
+
+    REQUIRE(output == "Asking (InNatural (Natural Two))\n");
+    REQUIRE(env -> ask_search == SEARCH_IDDFS);
+
+    // The mode only applies to that ask
+    parseStatement("ask InNatural Two", env);
+    REQUIRE(env -> ask_search == SEARCH_BFS);
+
+    REQUIRE_THROWS(parseStatement("declare var iddfs Natural", env));
+
+    parseStatement("ask bidir InNatural Two", env);
+    REQUIRE(env -> ask_search == SEARCH_BIDIRECTIONAL);
+
+    delete env;
+}
+
+TEST_CASE("Ask statement with best first search", "[parseStatement]") {
+    Env *env = new Env();
+    parseStatement("source tests/nat.rilab", env);
+
+    parseStatement("ask best overlap InNatural Two", env);
+    REQUIRE(env -> ask_search == SEARCH_BEST_FIRST);
+    REQUIRE(env -> ask_heuristic == HEURISTIC_OVERLAP);
+
+    REQUIRE_THROWS(parseStatement("ask best InNatural Two", env));
+
+    delete env;
+}
+
+TEST_CASE("Save and load statements", "[parseStatement]") {
+    Env *env = new Env();
+    parseStatement("source tests/nat.rilab", env);
+    parseStatement("source tests/test.rilab", env);
+    parseStatement("declare conjunction &", env);
+
+    string output = parseStatement("save bin/test.snapshot", env);
+    REQUIRE(output == "Saved " + std::to_string(env -> rule_terms.size()) + " rules to bin/test.snapshot\n");
+
+    Env *loaded = new Env();
+    output = parseStatement("load bin/test.snapshot", loaded);
+    REQUIRE(output == "Loaded " + std::to_string(env -> rule_terms.size()) + " rules from bin/test.snapshot\n");
+
+    // The loaded env has the same declarations and rules, and can prove the same goals
+    REQUIRE(parseStatement("show", loaded) == parseStatement("show", env));
+    REQUIRE(loaded -> conjunctions == env -> conjunctions);
+    REQUIRE(loaded -> symbols -> kind(loaded -> symbols -> find("Zero")) == env -> symbols -> kind(env -> symbols -> find("Zero")));
+
+    // Loading declares everything again, so the names are taken now
+    REQUIRE_THROWS(parseStatement("load bin/test.snapshot", loaded));
+    REQUIRE(loaded -> rule_terms.size() == env -> rule_terms.size());
+
+    Env *other = new Env();
+    REQUIRE_THROWS(parseStatement("load tests/nat.rilab", other));
+    REQUIRE(other -> operators.empty());
+    delete other;
+
+    REQUIRE_THROWS(parseStatement("load bin/missing.snapshot", loaded));
+
+    delete loaded;
+    delete env;
+}
+
+// Write a snapshot by hand: the header and name table, then the declarations, terms and rules as given.
+static void writeSnapshot(const string &path, const vector<string> &names, const vector<uint32_t> &words) {
+    vector<uint32_t> file = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, (uint32_t) names.size()};
+    for (const string &name : names) {
+        file.push_back(name.size());
+
+        size_t start = file.size();
+        file.resize(start + (name.size() + 3) / 4, 0);
+        name.copy((char*) &file[start], name.size());
+    }
+
+    file.insert(file.end(), words.begin(), words.end());
+
+    std::ofstream f(path, std::ios::binary);
+    f.write((const char*) file.data(), file.size() * sizeof(uint32_t));
+}
+
+TEST_CASE("Invalid snapshots are rejected", "[parseStatement]") {
+    vector<string> names = {"", "Bool", "P", "Q", "Natural", "Zero"};
+
+    // Type Natural, operator P of type Bool with no arguments, literal Zero of type Natural
+    vector<uint32_t> types = {1, 4, 0};
+    vector<uint32_t> operators = {1, 2, 1, 1};
+    vector<uint32_t> values = {0, 1, 5, 4};
+
+    auto snapshot = [&](const vector<uint32_t> &ops, const vector<uint32_t> &conjunctions, const vector<uint32_t> &terms) {
+        vector<uint32_t> words = types;
+        words.insert(words.end(), ops.begin(), ops.end());
+        words.insert(words.end(), values.begin(), values.end());
+        words.insert(words.end(), conjunctions.begin(), conjunctions.end());
+        words.insert(words.end(), terms.begin(), terms.end());
+        words.insert(words.end(), {1, 0});
+        writeSnapshot("bin/test_invalid.snapshot", names, words);
+    };
+
+    // The rule (P)
+    snapshot(operators, {0}, {1, 1, 0, 2, 0});
+
+    Env *env = new Env();
+    REQUIRE(parseStatement("load bin/test_invalid.snapshot", env) == "Loaded 1 rules from bin/test_invalid.snapshot\n");
+    delete env;
+
+    // P takes an argument, but the term has no children
+    snapshot({1, 2, 2, 1, 1}, {0}, {1, 1, 0, 2, 0});
+    env = new Env();
+    REQUIRE_THROWS_WITH(parseStatement("load bin/test_invalid.snapshot", env), "ParseException: Invalid snapshot file");
+    REQUIRE(env -> operators.empty());
+    delete env;
+
+    // Q was never declared
+    snapshot(operators, {0}, {1, 1, 0, 3, 0});
+    env = new Env();
+    REQUIRE_THROWS_WITH(parseStatement("load bin/test_invalid.snapshot", env), "ParseException: Invalid snapshot file");
+    REQUIRE(env -> operators.empty());
+    delete env;
+
+    // P is an operator, not a value
+    snapshot(operators, {0}, {1, 1, 2, 0, 0});
+    env = new Env();
+    REQUIRE_THROWS_WITH(parseStatement("load bin/test_invalid.snapshot", env), "ParseException: Invalid snapshot file");
+    REQUIRE(env -> operators.empty());
+    delete env;
+
+    // The rule (Natural Zero) isn't of type Bool
+    snapshot(operators, {0}, {1, 4, 5, 0, 0});
+    env = new Env();
+    REQUIRE_THROWS_WITH(parseStatement("load bin/test_invalid.snapshot", env), "ParseException: Invalid snapshot file");
+    REQUIRE(env -> operators.empty());
+    delete env;
+
+    // Conjunctions need at least two arguments
+    snapshot(operators, {1, 2}, {1, 1, 0, 2, 0});
+    env = new Env();
+    REQUIRE_THROWS_WITH(parseStatement("load bin/test_invalid.snapshot", env), "ParseException: Invalid snapshot file");
+    REQUIRE(env -> operators.empty());
+    delete env;
+}
+
+TEST_CASE("Source file of declarations", "[parseStatement]") {
+    // Enough rules that several threads load them
+    std::ofstream f("bin/test_bulk.rilab");
+    f << "declare type Natural\ndeclare operator S Natural Natural\ndeclare operator InNatural Bool _\ndeclare literal Zero Natural\n\n";
+
+    string expected = "Added Type Natural.\nAdded Operator S with types out=Natural, in=Natural, \nAdded Operator InNatural with types out=Bool, in=_, \nAdded literal Zero of type Natural.\n\n";
+    string term = "Zero";
+    string printed = "(Natural Zero)";
+    for (size_t i = 0; i < 300; i++) {
+        f << "declare rule InNatural " << (i ? "(" + term + ")" : term) << "\n";
+        expected += "Added Rule (InNatural " + printed + ")\n";
+
+        term = "S " + (i ? "(" + term + ")" : term);
+        printed = "(S " + printed + ")";
+    }
+
+    f << "declare var x Natural";
+    expected += "Added variable x of type Natural.\n";
+    f.close();
+
+    Env *env = new Env();
+    REQUIRE(parseStatement("source bin/test_bulk.rilab", env) == expected);
+    REQUIRE(env -> rule_terms.size() == 300);
+    REQUIRE(env -> variables["x"] == "Natural");
+
+    // A bad rule stops the source there, with the rules above it added
+    f.open("bin/test_bulk.rilab");
+    f << "declare type Natural\ndeclare literal Zero Natural\ndeclare operator InNatural Bool _\n";
+    for (size_t i = 0; i < 200; i++) {
+        f << "declare rule " << (i == 150 ? "Zero" : "InNatural Zero") << "\n";
+    }
+    f << "declare literal One Natural\ndeclare operator And Bool Bool Bool\ndeclare conjunction And\n";
+    f.close();
+
+    // Nothing below the bad rule is declared either
+    Env *failed = new Env();
+    REQUIRE_THROWS(parseStatement("source bin/test_bulk.rilab", failed));
+    REQUIRE(failed -> rule_terms.size() == 150);
+    REQUIRE(failed -> literals.count("Zero") == 1);
+    REQUIRE(failed -> literals.count("One") == 0);
+    REQUIRE(failed -> operators.count("And") == 0);
+    REQUIRE(failed -> conjunctions.empty());
+
+    // A rule using a name declared below it fails, like it would running the lines one at a time
+    f.open("bin/test_bulk.rilab");
+    f << "declare type Natural\ndeclare operator InNatural Bool _\ndeclare rule InNatural Zero\ndeclare literal Zero Natural\n";
+    f.close();
+
+    Env *early = new Env();
+    REQUIRE_THROWS_WITH(parseStatement("source bin/test_bulk.rilab", early), "ParseException: Undefined non-literal input");
+    REQUIRE(early -> type_names.count("Natural") == 1);
+    REQUIRE(early -> literals.count("Zero") == 0);
+    REQUIRE(early -> rule_terms.empty());
+    delete early;
+
+    REQUIRE_THROWS(parseStatement("source bin/missing.rilab", failed));
+
+    delete failed;
+    delete env;
+}
+
+TEST_CASE("Circular and repeated source statements", "[parseStatement]") {
+    std::ofstream f("bin/test_cycle_a.rilab");
+    f << "source bin/test_cycle_b.rilab";
+    f.close();
+
+    f.open("bin/test_cycle_b.rilab");
+    f << "source tests/nat.rilab\nsource bin/test_cycle_a.rilab";
+    f.close();
+
+    Env *env = new Env();
+    REQUIRE_THROWS(parseStatement("source bin/test_cycle_a.rilab", env));
+
+    // Sourcing a file of declarations again adds nothing new, however many files source it
+    f.open("bin/test_cycle_b.rilab");
+    f << "source tests/nat.rilab\nsource rules/logical_operators.rilab";
+    f.close();
+
+    size_t rule_count = env -> rule_terms.size();
+    parseStatement("source tests/nat.rilab", env);
+    REQUIRE(parseStatement("source tests/nat.rilab", env) == "Already sourced tests/nat.rilab\n");
+    parseStatement("source bin/test_cycle_a.rilab", env);
+    parseStatement("source rules/logical_operators.rilab", env);
+
+    REQUIRE(env -> rule_terms.size() == rule_count + 4);
+    REQUIRE(env -> operators.find("&") != env -> operators.end());
+
+    // So does a file that uses names declared before it
+    f.open("bin/test_cycle_c.rilab");
+    f << "declare rule InNatural (S (S Zero))";
+    f.close();
+
+    REQUIRE(parseStatement("source bin/test_cycle_c.rilab", env).find("Added") != string::npos);
+    REQUIRE(parseStatement("source bin/test_cycle_c.rilab", env) == "Already sourced bin/test_cycle_c.rilab\n");
+    REQUIRE(env -> rule_terms.size() == rule_count + 5);
+
+    // The include graph is kept by canonical path
+    char *a = realpath("bin/test_cycle_a.rilab", NULL);
+    char *b = realpath("bin/test_cycle_b.rilab", NULL);
+    REQUIRE(env -> sources -> includes(a).count(b) == 1);
+    REQUIRE(env -> sources -> includes(b).size() == 2);
+    free(a);
+    free(b);
+
+    // A file declaring a name the env uses differently still fails
+    Env *other = new Env();
+    parseStatement("declare type Natural", other);
+    parseStatement("declare var Zero Natural", other);
+    REQUIRE_THROWS(parseStatement("source tests/nat.rilab", other));
+    REQUIRE(other -> rule_terms.empty());
+
+    delete other;
+    delete env;
+}
+
+TEST_CASE("Sourced files are only reused for equal contents", "[parseStatement]") {
+    SourceManager sources;
+    sources.add("declare type A");
+
+    REQUIRE(sources.loaded("declare type A"));
+
+    // Same length, different bytes
+    REQUIRE_FALSE(sources.loaded("declare type B"));
+    REQUIRE_FALSE(sources.loaded("declare type"));
 }
\ No newline at end of file
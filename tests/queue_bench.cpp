@@ -0,0 +1,77 @@
+#include "../src/data/mutexQueue.h"
+#include "../src/data/threadQueue.h"
+#include "../src/data/tree.h"
+
+#include <chrono>
+#include <iostream>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+// Compare ThreadQueue against the old mutex queue.
+// Every thread alternates push and pop, so all threads act as both producer and consumer.
+// Usage: bin/queue_bench [ops_per_thread]
+
+static size_t ops_per_thread = 200000;
+
+template <typename Queue>
+struct BenchArgs {
+    Queue *queue;
+    ProofTreeNode *node;
+};
+
+template <typename Queue>
+static void *benchWorker(void *arg) {
+    BenchArgs<Queue> *args = (BenchArgs<Queue>*) arg;
+
+    for (size_t i = 0; i < ops_per_thread; i++) {
+        args -> queue -> push(args -> node);
+        args -> queue -> pop();
+    }
+
+    return NULL;
+}
+
+// Returns millions of (push + pop) pairs per second.
+template <typename Queue>
+static double runBench(size_t thread_count) {
+    Queue queue;
+    ProofTreeNode node;
+
+    vector<pthread_t> threads(thread_count);
+    vector<BenchArgs<Queue>> args(thread_count, {&queue, &node});
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, benchWorker<Queue>, &args[i]);
+    }
+
+    for (size_t i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return (double) (thread_count * ops_per_thread) / elapsed.count() / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2) ops_per_thread = std::stoul(argv[1]);
+
+    cout << "threads\tmutex (Mops/s)\tlock-free (Mops/s)" << endl;
+
+    for (size_t threads = 1; threads <= 64; threads *= 2) {
+        double mutex_rate = runBench<MutexQueue>(threads);
+        double lock_free_rate = runBench<ThreadQueue>(threads);
+
+        cout << threads << "\t" << mutex_rate << "\t" << lock_free_rate << endl;
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,390 @@
+#include "catch.hpp"
+
+#include "../src/data/failureCache.h"
+#include "../src/data/meetingTable.h"
+#include "../src/data/rule.h"
+#include "../src/data/ruleIndex.h"
+#include "../src/data/symbols.h"
+#include "../src/data/term.h"
+#include "../src/data/tree.h"
+#include "../src/data/typeUnifier.h"
+#include "../src/data/visitedTable.h"
+#include "../src/parse.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+Env *setupTermEnv() {
+    Env *env = new Env();
+    parseStatement("source tests/nat.rilab", env);
+    return env;
+}
+
+TEST_CASE("Equal rules share a single id", "[TermStore]") {
+    Env *env = setupTermEnv();
+    RuleTree *fst = parseRule("InNatural (S (S Zero))", env);
+    RuleTree *snd = parseRule("InNatural (S (S Zero))", env);
+
+    REQUIRE(env -> intern(fst) == env -> intern(snd));
+
+    delete fst;
+    delete snd;
+    delete env;
+}
+
+TEST_CASE("Different rules get different ids", "[TermStore]") {
+    Env *env = setupTermEnv();
+    RuleTree *fst = parseRule("InNatural (S Zero)", env);
+    RuleTree *snd = parseRule("InNatural (S x)", env);
+
+    REQUIRE(env -> intern(fst) != env -> intern(snd));
+
+    delete fst;
+    delete snd;
+    delete env;
+}
+
+TEST_CASE("Subterms are shared", "[TermStore]") {
+    Env *env = setupTermEnv();
+    RuleTree *rule = parseRule("InNatural (S (S Zero))", env);
+    RuleTree *inner = parseRule("S Zero", env);
+
+    TermId rule_id = env -> intern(rule);
+    TermId inner_id = env -> intern(inner);
+
+    const Term &outer = env -> terms -> get(env -> terms -> get(rule_id).sub_terms[0]);
+    REQUIRE(outer.sub_terms[0] == inner_id);
+
+    delete rule;
+    delete inner;
+    delete env;
+}
+
+TEST_CASE("Scratch terms are dropped unless kept", "[TermStore]") {
+    TermStore terms;
+
+    Term zero;
+    zero.rule_value = 5;
+    TermId kept_zero = terms.make(zero);
+
+    Term succ;
+    succ.rule_op = 6;
+    succ.sub_terms = {kept_zero};
+
+    terms.openScratch();
+
+    // Terms that exist already keep their id, new ones go to the scratch space
+    REQUIRE(terms.make(zero) == kept_zero);
+
+    TermId one = terms.make(succ);
+    succ.sub_terms = {one};
+    TermId two = terms.make(succ);
+
+    REQUIRE(TermStore::isScratch(one));
+    REQUIRE(terms.make(succ) == two);
+    REQUIRE(terms.size() == 1);
+    REQUIRE(terms.scratchSize() == 2);
+
+    // Keeping a term keeps its subterms too
+    TermId kept_two = terms.keep(two);
+    REQUIRE(!TermStore::isScratch(kept_two));
+    REQUIRE(terms.size() == 3);
+
+    terms.dropScratch();
+    REQUIRE(terms.scratchSize() == 0);
+
+    // New terms are no longer scratch, and the kept term is found again
+    succ.sub_terms = {kept_zero};
+    TermId kept_one = terms.make(succ);
+    succ.sub_terms = {kept_one};
+    REQUIRE(terms.make(succ) == kept_two);
+    REQUIRE(terms.get(kept_two).sub_terms[0] == kept_one);
+}
+
+TEST_CASE("Terms round trip through RuleTree", "[TermStore]") {
+    Env *env = setupTermEnv();
+    RuleTree *rule = parseRule("--> (InNatural x) (InNatural (S x))", env);
+
+    TermId id = env -> intern(rule);
+    RuleTree *copy = env -> toRuleTree(id);
+
+    ostringstream printed;
+    env -> printTerm(printed, id);
+
+    ostringstream original;
+    original << *rule;
+
+    REQUIRE(*copy == *rule);
+    REQUIRE(printed.str() == original.str());
+
+    delete rule;
+    delete copy;
+    delete env;
+}
+
+TEST_CASE("Symbols are tagged with their kind", "[SymbolTable]") {
+    Env *env = setupTermEnv();
+
+    REQUIRE(env -> symbols -> kind(env -> symbol("Natural")) == SYMBOL_TYPE);
+    REQUIRE(env -> symbols -> kind(env -> symbol("S")) == SYMBOL_OPERATOR);
+    REQUIRE(env -> symbols -> kind(env -> symbol("x")) == SYMBOL_VARIABLE);
+    REQUIRE(env -> symbols -> kind(env -> symbol("Zero")) == SYMBOL_LITERAL);
+    REQUIRE(env -> symbols -> kind(env -> symbol("12")) == SYMBOL_NONE);
+
+    REQUIRE(env -> symbol("_") == WILDCARD_SYMBOL);
+    REQUIRE(env -> symbol("-->") == IMPLIES_SYMBOL);
+    REQUIRE(env -> symbols -> name(env -> symbol("Natural")) == "Natural");
+
+    delete env;
+}
+
+TEST_CASE("Typevars are tagged separately from types", "[SymbolTable]") {
+    Env *env = setupTermEnv();
+    parseStatement("declare typevar T", env);
+
+    REQUIRE(env -> symbols -> kind(env -> symbol("T")) == SYMBOL_TYPEVAR);
+
+    delete env;
+}
+
+TEST_CASE("Rule index only returns rules with a matching conclusion", "[RuleIndex]") {
+    Env *env = new Env();
+    parseStatement("source rules/list.rilab", env);
+
+    RuleTree *goal = parseRule("InList Five (Push Five Empty)", env);
+    TermId goal_id = env -> intern(goal);
+
+    vector<RuleCandidate> candidates = env -> rule_index -> applicableRules(goal_id);
+    REQUIRE(candidates.size() == 1);
+    REQUIRE(env -> terms -> get(candidates[0].rule).rule_op == IMPLIES_SYMBOL);
+    REQUIRE(candidates[0].direction);
+
+    vector<TermId> matches = env -> rule_index -> matchingRules(goal_id);
+    REQUIRE(matches.size() == 1);
+    REQUIRE(env -> terms -> get(matches[0]).rule_op == env -> symbol("InList"));
+
+    delete goal;
+    delete env;
+}
+
+TEST_CASE("Rule index distinguishes literals", "[RuleIndex]") {
+    Env *env = setupTermEnv();
+
+    RuleTree *zero = parseRule("InNatural Zero", env);
+    RuleTree *two = parseRule("InNatural Two", env);
+    RuleTree *var = parseRule("InNatural x", env);
+
+    REQUIRE(env -> rule_index -> matchingRules(env -> intern(zero)).size() == 1);
+    REQUIRE(env -> rule_index -> matchingRules(env -> intern(two)).empty());
+    REQUIRE(env -> rule_index -> matchingRules(env -> intern(var)).empty());
+
+    // Two can only be rewritten by the --<> rule, matching its left side
+    vector<RuleCandidate> candidates = env -> rule_index -> applicableRules(env -> intern(two));
+    REQUIRE(candidates.size() == 1);
+    REQUIRE(!candidates[0].direction);
+
+    delete zero;
+    delete two;
+    delete var;
+    delete env;
+}
+
+TEST_CASE("Visited goals are only expanded at their shallowest depth", "[VisitedTable]") {
+    VisitedTable visited;
+
+    REQUIRE(visited.visit(3, 2));
+    REQUIRE(!visited.visit(3, 2));
+    REQUIRE(!visited.visit(3, 5));
+    REQUIRE(visited.visit(3, 1));
+    REQUIRE(visited.visit(4, 5));
+    REQUIRE(visited.size() == 2);
+
+    visited.clear();
+    REQUIRE(visited.visit(3, 5));
+}
+
+TEST_CASE("Failed goals are pruned for the same or fewer steps", "[FailureCache]") {
+    FailureCache failures;
+
+    REQUIRE(!failures.failed(3, 0));
+
+    failures.fail(3, 4);
+    failures.fail(3, 2);
+
+    REQUIRE(failures.failed(3, 4));
+    REQUIRE(failures.failed(3, 1));
+    REQUIRE(!failures.failed(3, 5));
+    REQUIRE(!failures.failed(4, 1));
+    REQUIRE(failures.size() == 1);
+
+    failures.clear();
+    REQUIRE(!failures.failed(3, 1));
+}
+
+TEST_CASE("Failure cache forgets its oldest goals once full", "[FailureCache]") {
+    FailureCache failures(640);
+
+    size_t largest = 0;
+
+    for (TermId goal = 0; goal < 10000; goal++) {
+        failures.fail(goal, 3);
+        largest = std::max(largest, failures.size());
+    }
+
+    REQUIRE(largest == 640);
+    REQUIRE(failures.size() == 640);
+    REQUIRE(failures.failed(9999, 3));
+    REQUIRE(!failures.failed(0, 3));
+
+    // Deepening a kept goal doesn't take up more room
+    failures.fail(9999, 5);
+    REQUIRE(failures.failed(9999, 5));
+    REQUIRE(failures.size() == 640);
+}
+
+TEST_CASE("Meeting table pairs nodes with the same root operator", "[MeetingTable]") {
+    Env *env = setupTermEnv();
+
+    ProofTreeNode goal, fact, other;
+    RuleTree *two_rule = parseRule("InNatural Two", env);
+    RuleTree *zero_rule = parseRule("InNatural Zero", env);
+    RuleTree *succ_rule = parseRule("S Zero", env);
+
+    TermId two = env -> intern(two_rule);
+    TermId zero = env -> intern(zero_rule);
+    TermId succ = env -> intern(succ_rule);
+
+    vector<ProofTreeNode*> partners;
+
+    env -> meetings -> addBackward(two, &goal, partners);
+    REQUIRE(partners.empty());
+
+    // Forward nodes see the goals with the same root, and each fact is only recorded once
+    REQUIRE(env -> meetings -> addForward(zero, &fact, partners));
+    REQUIRE(partners.size() == 1);
+    REQUIRE(partners[0] == &goal);
+
+    REQUIRE(!env -> meetings -> addForward(zero, &other, partners));
+    REQUIRE(env -> meetings -> addForward(succ, &other, partners));
+    REQUIRE(partners.empty());
+
+    // Only the first meeting counts
+    REQUIRE(env -> meetings -> meet(&goal, &fact));
+    REQUIRE(!env -> meetings -> meet(&goal, &other));
+    REQUIRE(env -> meetings -> partner(&goal) == &fact);
+    REQUIRE(env -> meetings -> partner(&other) == nullptr);
+
+    env -> meetings -> clear();
+    REQUIRE(env -> meetings -> partner(&goal) == nullptr);
+    REQUIRE(env -> meetings -> addForward(zero, &fact, partners));
+
+    delete two_rule;
+    delete zero_rule;
+    delete succ_rule;
+    delete env;
+}
+
+TEST_CASE("Meeting table keeps the shallowest derivation of each fact", "[MeetingTable]") {
+    Env *env = setupTermEnv();
+
+    ProofTreeNode goal, later_goal, deep, shallow, deeper;
+    deep.depth = 3;
+    shallow.depth = 1;
+    deeper.depth = 2;
+
+    RuleTree *two_rule = parseRule("InNatural Two", env);
+    RuleTree *zero_rule = parseRule("InNatural Zero", env);
+
+    TermId two = env -> intern(two_rule);
+    TermId zero = env -> intern(zero_rule);
+
+    vector<ProofTreeNode*> partners;
+
+    env -> meetings -> addBackward(two, &goal, partners);
+    REQUIRE(env -> meetings -> addForward(zero, &deep, partners));
+
+    // A shorter derivation is recorded in place of the deeper one, and meets the goals again
+    partners.clear();
+    REQUIRE(env -> meetings -> addForward(zero, &shallow, partners));
+    REQUIRE(partners.size() == 1);
+    REQUIRE(partners[0] == &goal);
+
+    partners.clear();
+    REQUIRE(!env -> meetings -> addForward(zero, &deeper, partners));
+    REQUIRE(partners.empty());
+
+    env -> meetings -> addBackward(two, &later_goal, partners);
+    REQUIRE(partners.size() == 1);
+    REQUIRE(partners[0] == &shallow);
+
+    delete two_rule;
+    delete zero_rule;
+    delete env;
+}
+
+TEST_CASE("Meeting table pairs facts without a root operator with every goal", "[MeetingTable]") {
+    Env *env = setupTermEnv();
+
+    ProofTreeNode goal, later_goal, fact;
+    RuleTree *two_rule = parseRule("InNatural Two", env);
+    RuleTree *succ_rule = parseRule("S Zero", env);
+    RuleTree *var_rule = parseRule("x", env);
+
+    TermId two = env -> intern(two_rule);
+    TermId succ = env -> intern(succ_rule);
+    TermId var = env -> intern(var_rule);
+
+    vector<ProofTreeNode*> partners;
+
+    env -> meetings -> addBackward(two, &goal, partners);
+    REQUIRE(partners.empty());
+
+    // A variable fact sees the goals recorded before it, whatever their root
+    REQUIRE(env -> meetings -> addForward(var, &fact, partners));
+    REQUIRE(partners.size() == 1);
+    REQUIRE(partners[0] == &goal);
+
+    // and goals recorded after it see the variable fact
+    env -> meetings -> addBackward(succ, &later_goal, partners);
+    REQUIRE(partners.size() == 1);
+    REQUIRE(partners[0] == &fact);
+
+    delete two_rule;
+    delete succ_rule;
+    delete var_rule;
+    delete env;
+}
+
+TEST_CASE("Type unifier merges a cycle of TypeVars", "[TypeUnifier]") {
+    TypeUnifier<string> unifier;
+    size_t t = unifier.variable("T");
+    size_t u = unifier.variable("U");
+    size_t v = unifier.variable("V");
+
+    // T = U, U = V then V = T closes the cycle on one class instead of failing or looping
+    REQUIRE(unifier.unify(t, u));
+    REQUIRE(unifier.unify(u, v));
+    REQUIRE(unifier.unify(v, t));
+    REQUIRE(unifier.find(t) == unifier.find(v));
+    REQUIRE(unifier.binding(u) == nullptr);
+    REQUIRE(unifier.lookup("T") == nullptr);
+
+    // Binding any variable of the cycle binds all of them, once
+    REQUIRE(unifier.bind(v, "Natural"));
+    REQUIRE(*unifier.binding(t) == "Natural");
+    REQUIRE(*unifier.lookup("U") == "Natural");
+    REQUIRE(unifier.bind(t, "Natural"));
+    REQUIRE(!unifier.bind(u, "Bool"));
+
+    // and it can't be unified with a class bound to another type
+    size_t w = unifier.variable("W");
+    REQUIRE(unifier.bind(w, "Bool"));
+    REQUIRE(!unifier.unify(w, t));
+    REQUIRE(*unifier.lookup("T") == "Natural");
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "catch.hpp"
 
+#include "../src/data/cancelToken.h"
 #include "../src/data/rule.h"
+#include "../src/data/scheduler.h"
 #include "../src/data/threadQueue.h"
 #include "../src/data/tree.h"
 #include "../src/logic.h"
@@ -11,7 +13,6 @@
 #include <pthread.h>
 #include <queue>
 #include <set>
-#include <signal.h>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -32,69 +33,501 @@ static Env *env;
 
 static size_t recursion_limit;
 
-static ThreadQueue *tasks;
+static Scheduler *scheduler;
 static ThreadQueue *results;
 
-extern bool queue_locked;
-extern bool stop_ask;
+static pthread_t workers[2];
+static size_t worker_ids[2] = {0, 1};
 
-void handleSigint(int sig) {
-    stop_ask = true;
-    queue_locked = true;
+void *runWorker (void *worker) {
+    runSchedulerWorker(env, scheduler, results, *(size_t*) worker, recursion_limit);
+    return NULL;
 }
 
-void *runWorker (void *unused) {
-    // This will stop when main returns, so no need to have a variable to force exit.
-    while (true) {
-        // Get a new task to run.
-        ProofTreeNode *node = tasks -> pop();
+void setupTest(const string &source = "tests/nat.rilab", size_t limit = 5) {
+    env = new Env();
+    parseStatement("source " + source, env);
 
-        try {
-            ProofTreeNode *result = runAskWorker(env, recursion_limit, node);
-            results -> push(result);
-        } catch (char const *e) {
-            results -> push(nullptr);
-        }
-        
-    }
+    scheduler = new Scheduler(2);
+    results = new ThreadQueue();
 
-}
+    recursion_limit = limit;
 
-void setupTest() {
-    env = new Env();
-    parseStatement("source tests/nat.rilab", env);
+    for (size_t i = 0; i < 2; i++) {
+        pthread_create(workers + i, NULL, runWorker, worker_ids + i);
+    }
 
-    tasks = new ThreadQueue();
-    results = new ThreadQueue();
+}
 
-    recursion_limit = 5;
+void teardownTest() {
+    scheduler -> shutdown();
 
-    signal(SIGINT, handleSigint);
+    for (size_t i = 0; i < 2; i++) {
+        pthread_join(workers[i], NULL);
+    }
 
+    delete scheduler;
+    delete results;
+    delete env;
 }
 
 TEST_CASE("Simple runAsk for multithread") {
     setupTest();
 
-    pthread_t worker;
-    pthread_create(&worker, NULL, runWorker, NULL);
-
     env -> ask_rule = parseRule("InNatural Two", env);
-    string proof = runAsk(env, tasks, results);
+    string proof = runAsk(env, scheduler, results);
 
     REQUIRE(proof == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (S (Natural Zero))))\nApply rule (--<> (InNatural (Natural Two)) (InNatural (S (S (Natural Zero)))))\n\n");
 
+    teardownTest();
 }
 
 TEST_CASE("Simple runAsk for multithread (parseStatement)") {
     setupTest();
 
-    pthread_t worker;
-    pthread_create(&worker, NULL, runWorker, NULL);
+    parseStatement("ask InNatural Two", env);
+    string proof = runAsk(env, scheduler, results);
+
+    REQUIRE(proof == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (S (Natural Zero))))\nApply rule (--<> (InNatural (Natural Two)) (InNatural (S (S (Natural Zero)))))\n\n");
+
+    teardownTest();
+}
+
+TEST_CASE("Iterative deepening runAsk for multithread") {
+    setupTest();
+
+    parseStatement("ask iddfs InNatural Two", env);
+    string proof = runAsk(env, scheduler, results);
+
+    REQUIRE(proof == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (S (Natural Zero))))\nApply rule (--<> (InNatural (Natural Two)) (InNatural (S (S (Natural Zero)))))\n\n");
+
+    teardownTest();
+}
+
+TEST_CASE("Bidirectional runAsk for multithread") {
+    setupTest();
+
+    // Wherever the halves meet, the stitched proof has the same steps
+    parseStatement("ask bidir InNatural Two", env);
+    string proof = runAsk(env, scheduler, results);
+
+    REQUIRE(proof == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (S (Natural Zero))))\nApply rule (--<> (InNatural (Natural Two)) (InNatural (S (S (Natural Zero)))))\n\n");
+
+    // Each half only searches about half the limit, but together they still reach it
+    parseStatement("ask bidir InNatural (S (S (S (S (S Zero)))))", env);
+    proof = runAsk(env, scheduler, results);
+
+    size_t steps = 0;
+    for (size_t at = proof.find("Apply rule"); at != string::npos; at = proof.find("Apply rule", at + 1)) steps++;
+    REQUIRE(steps == 5);
+
+    // Forget the last proof's lemmas, which would prove this in a single step
+    env -> lemmas -> clear();
+    parseStatement("ask bidir InNatural (S (S (S (S (S (S Zero))))))", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+
+    teardownTest();
+}
+
+TEST_CASE("Best first runAsk for multithread") {
+    setupTest();
+
+    const char *heuristics[] = {"size", "overlap", "history"};
+
+    for (const char *heuristic : heuristics) {
+        parseStatement(string("ask best ") + heuristic + " InNatural Two", env);
+        string proof = runAsk(env, scheduler, results);
+
+        REQUIRE(proof == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (S (Natural Zero))))\nApply rule (--<> (InNatural (Natural Two)) (InNatural (S (S (Natural Zero)))))\n\n");
+
+        // Search again with the next heuristic, instead of reusing the proof
+        env -> lemmas -> clear();
+    }
+
+    // Both rules of the proof are remembered
+    REQUIRE(env -> rule_successes.size() == 2);
+
+    teardownTest();
+}
+
+TEST_CASE("runAsk reuses the lemmas of earlier proofs") {
+    setupTest();
 
     parseStatement("ask InNatural Two", env);
-    string proof = runAsk(env, tasks, results);
+    runAsk(env, scheduler, results);
+
+    // Every goal on the proof's path is a lemma
+    REQUIRE(env -> lemmas -> size() == 4);
+
+    // Without the lemma, this would need two more nodes than the budget allows
+    env -> node_budget = 2;
+    parseStatement("ask InNatural (S (S (S Zero)))", env);
+    string proof = runAsk(env, scheduler, results);
+
+    REQUIRE(proof == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (S (Natural Zero))))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n");
+
+    // A proven ask is answered without searching at all
+    env -> node_budget = 1;
+    parseStatement("ask InNatural (S (S Zero))", env);
+    REQUIRE(runAsk(env, scheduler, results) == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n");
+
+    teardownTest();
+}
+
+TEST_CASE("Lemmas only generalize their variables") {
+    setupTest("rules/list.rilab", 8);
+
+    parseStatement("ask InList 7 FibList", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+
+    parseStatement("ask InList 3 FibList", env);
+    runAsk(env, scheduler, results);
+
+    // The lemmas were proven for 3, so they can't prove 7 or Five
+    parseStatement("ask InList 7 FibList", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+
+    parseStatement("ask bidir InList Five FibList", env);
+    string proof = runAsk(env, scheduler, results);
+    REQUIRE(proof.find("(InList (Int 3)") == string::npos);
+    REQUIRE(proof.find("(InList (Int Five) (Push (Int 3) (Push (Int Five) (List Empty))))") != string::npos);
+
+    // A lemma with variables proves any goal it generalizes, with its proof instantiated for that goal
+    parseStatement("ask InList y (Push 1 (Push y lst2))", env);
+    runAsk(env, scheduler, results);
+
+    env -> node_budget = 1;
+    parseStatement("ask InList 4 (Push 1 (Push 4 Empty))", env);
+    REQUIRE(runAsk(env, scheduler, results) == "==> (InList (Int 4) (Push (Int 4) (List Empty)))\nApply rule (--> (InList (Int x) (List lst1)) (InList (Int x) (Push (Int y) (List lst1))))\n\n");
+
+    teardownTest();
+}
+
+TEST_CASE("runAsk answers from saturated facts") {
+    setupTest();
+
+    REQUIRE_THROWS_WITH(parseStatement("saturate 99999999999999999999999", env), "ParseException: Expected saturate [max_facts].");
+    REQUIRE(parseStatement("saturate 10", env) == "Saturated with 10 facts.\n");
+
+    parseStatement("ask InNatural Two", env);
+    string proof = runAsk(env, scheduler, results);
 
     REQUIRE(proof == "==> (InNatural (Natural Zero))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (Natural Zero)))\nApply rule (--> (InNatural (Natural x)) (InNatural (S (Natural x))))\n\n==> (InNatural (S (S (Natural Zero))))\nApply rule (--<> (InNatural (Natural Two)) (InNatural (S (S (Natural Zero)))))\n\n");
 
+    teardownTest();
+}
+
+TEST_CASE("Unprovable runAsk exhausts the search") {
+    setupTest();
+
+    parseStatement("ask InNatural x", env);
+    REQUIRE_THROWS(runAsk(env, scheduler, results));
+
+    teardownTest();
+}
+
+TEST_CASE("Failed asks are remembered until a rule is declared") {
+    setupTest();
+
+    parseStatement("ask InNatural x", env);
+    REQUIRE_THROWS(runAsk(env, scheduler, results));
+    REQUIRE(env -> failures -> size() > 0);
+
+    // The ask is pruned at the root, so a single node is enough to give up
+    env -> node_budget = 1;
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+
+    // Iterative deepening prunes it too
+    parseStatement("ask iddfs InNatural x", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+
+    parseStatement("declare rule InNatural x", env);
+    REQUIRE(env -> failures -> size() == 0);
+
+    env -> node_budget = 0;
+    parseStatement("ask InNatural x", env);
+    REQUIRE(runAsk(env, scheduler, results) == "");
+
+    teardownTest();
+}
+
+TEST_CASE("Failed asks are retried once a lemma may prove them") {
+    setupTest();
+
+    // Seven steps, two more than the recursion limit
+    parseStatement("ask InNatural (S (S (S (S (S (S (S Zero)))))))", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+
+    parseStatement("ask InNatural (S (S (S Zero)))", env);
+    runAsk(env, scheduler, results);
+    REQUIRE(env -> failures -> size() == 0);
+
+    // With the lemma for three steps, the other four fit in the limit
+    parseStatement("ask InNatural (S (S (S (S (S (S (S Zero)))))))", env);
+    string proof = runAsk(env, scheduler, results);
+
+    size_t steps = 0;
+    for (size_t at = proof.find("Apply rule"); at != string::npos; at = proof.find("Apply rule", at + 1)) steps++;
+    REQUIRE(steps == 7);
+
+    teardownTest();
+}
+
+TEST_CASE("ask more continues a failed ask from its frontier") {
+    setupTest();
+
+    REQUIRE_THROWS(parseStatement("ask more 1", env));
+
+    // Seven steps, two more than the recursion limit
+    parseStatement("ask InNatural (S (S (S (S (S (S (S Zero)))))))", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+    REQUIRE(!env -> frontier -> empty());
+
+    // The same ask is pruned at the root, and keeps the frontier
+    REQUIRE_THROWS(runAsk(env, scheduler, results));
+    REQUIRE(!env -> frontier -> empty());
+
+    REQUIRE_THROWS(parseStatement("ask more", env));
+    REQUIRE_THROWS(parseStatement("ask more 0", env));
+    REQUIRE_THROWS_WITH(parseStatement("ask more 99999999999999999999999", env), "ParseException: Expected ask more <levels>.");
+
+    parseStatement("ask more 1", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+
+    // The proof has every step from the ask, not just the ones below the frontier
+    parseStatement("ask more 1", env);
+    string proof = runAsk(env, scheduler, results);
+
+    size_t steps = 0;
+    for (size_t at = proof.find("Apply rule"); at != string::npos; at = proof.find("Apply rule", at + 1)) steps++;
+    REQUIRE(steps == 7);
+
+    // A proved ask has nothing left to continue
+    REQUIRE(env -> frontier -> empty());
+    REQUIRE_THROWS(parseStatement("ask more 1", env));
+
+    teardownTest();
+}
+
+TEST_CASE("ask more can be repeated when the frontier has the same goal twice") {
+    setupTest();
+
+    parseStatement("ask InNatural (S (S (S (S (S (S (S (S Zero))))))))", env);
+    REQUIRE_THROWS(runAsk(env, scheduler, results));
+
+    // Repeat the first leaf on another path, so the next ask more searches its goal only once
+    Frontier *frontier = env -> frontier;
+    FrontierStep leaf = frontier -> get(frontier -> leaves()[0]);
+
+    FrontierStep path = FrontierStep();
+    path.goal = frontier -> get(0).goal;
+    path.rule = leaf.rule;
+    path.parent = 0;
+
+    leaf.parent = frontier -> add(path);
+    frontier -> addLeaf(frontier -> add(leaf));
+
+    parseStatement("ask more 1", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+
+    // The repeated leaf and the path to it are gone from the next frontier
+    set<TermId> goals;
+    for (size_t step : frontier -> leaves()) goals.insert(frontier -> get(step).goal);
+    REQUIRE(goals.size() == frontier -> leaves().size());
+
+    for (size_t i = 1; i < frontier -> size(); i++) {
+        REQUIRE(frontier -> get(i).goal != frontier -> get(0).goal);
+    }
+
+    parseStatement("ask more 1", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+
+    parseStatement("ask more 1", env);
+    string proof = runAsk(env, scheduler, results);
+
+    size_t steps = 0;
+    for (size_t at = proof.find("Apply rule"); at != string::npos; at = proof.find("Apply rule", at + 1)) steps++;
+    REQUIRE(steps == 8);
+
+    teardownTest();
+}
+
+TEST_CASE("Conjunctions are proven one side at a time") {
+    setupTest();
+
+    // No rule rewrites &, so the ask can only be proven by splitting it
+    parseStatement("declare operator & Bool Bool Bool", env);
+    parseStatement("ask & (InNatural (S (S (S Zero)))) (InNatural (S (S (S (S Zero)))))", env);
+    REQUIRE_THROWS(runAsk(env, scheduler, results));
+
+    parseStatement("declare conjunction &", env);
+
+    // Each side fits in the recursion limit, even though both together don't
+    for (string mode : {"bfs", "iddfs", "best size"}) {
+        env -> lemmas -> clear();
+
+        parseStatement("ask " + mode + " & (InNatural (S (S (S Zero)))) (InNatural (S (S (S (S Zero)))))", env);
+        string proof = runAsk(env, scheduler, results);
+
+        size_t steps = 0;
+        for (size_t at = proof.find("Apply rule"); at != string::npos; at = proof.find("Apply rule", at + 1)) steps++;
+
+        size_t conjuncts = 0;
+        for (size_t at = proof.find("Conjunct proven"); at != string::npos; at = proof.find("Conjunct proven", at + 1)) conjuncts++;
+
+        REQUIRE(steps == 7);
+        REQUIRE(conjuncts == 2);
+    }
+
+    // Both sides must be proven
+    parseStatement("ask & (InNatural Zero) (InNatural x)", env);
+    REQUIRE_THROWS(runAsk(env, scheduler, results));
+
+    teardownTest();
+}
+
+TEST_CASE("runAsk stops when the node budget runs out") {
+    setupTest();
+
+    env -> node_budget = 2;
+    parseStatement("ask InNatural Two", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "NodeBudgetExceeded: Processed too many nodes before finding a proof");
+
+    // The next ask starts with a fresh budget
+    env -> node_budget = 0;
+    string proof = runAsk(env, scheduler, results);
+    REQUIRE(proof != "");
+
+    teardownTest();
+}
+
+TEST_CASE("Iterative deepening stops when the node budget or the deadline runs out") {
+    // Every goal matches the conclusion of an & rule, so the search never runs out of goals
+    setupTest("rules/logical_operators.rilab", 20);
+
+    env -> node_budget = 1000;
+    parseStatement("ask iddfs a", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "NodeBudgetExceeded: Processed too many nodes before finding a proof");
+    REQUIRE(env -> cancel -> nodes() < 1100);
+
+    env -> node_budget = 0;
+    env -> timeout = 0.2;
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "DeadlineExceeded: Ran out of time before finding a proof");
+
+    teardownTest();
+}
+
+TEST_CASE("Asks drop the goals they made once they end") {
+    setupTest("rules/logical_operators.rilab", 8);
+
+    parseStatement("ask iddfs a", env);
+    size_t before = env -> terms -> size();
+
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+    REQUIRE(env -> terms -> size() == before);
+    REQUIRE(env -> terms -> scratchSize() == 0);
+
+    // The ask itself stays failed
+    env -> node_budget = 1;
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+
+    // A frontier keeps its goals in a store of its own
+    env -> node_budget = 0;
+    parseStatement("ask b", env);
+    before = env -> terms -> size();
+
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+    REQUIRE(env -> terms -> size() == before);
+    REQUIRE(!env -> frontier -> empty());
+
+    parseStatement("ask more 1", env);
+    REQUIRE_THROWS_WITH(runAsk(env, scheduler, results), "RecursionLimitReached: Was unable to prove the rule");
+    REQUIRE(env -> terms -> size() == before);
+
+    teardownTest();
+}
+
+TEST_CASE("Cancel tokens keep the first reason") {
+    CancelToken token;
+
+    token.reset(0, 3);
+    REQUIRE(!token.charge());
+    REQUIRE(!token.charge());
+    REQUIRE(!token.charge());
+    REQUIRE(token.charge());
+    REQUIRE(token.reason() == CANCEL_BUDGET);
+    REQUIRE(!token.cancel(CANCEL_INTERRUPT));
+
+    // The deadline is checked every so many nodes, so it has passed by now
+    token.reset(1e-9, 0);
+    REQUIRE(!token.cancelled());
+
+    for (size_t i = 0; i < 64; i++) token.charge();
+    REQUIRE(token.reason() == CANCEL_DEADLINE);
+
+    token.reset(0, 0);
+    REQUIRE(token.cancel(CANCEL_FOUND));
+    REQUIRE(token.cancelled());
+}
+
+TEST_CASE("Idle workers steal from the back of other deques") {
+    Scheduler local(2);
+
+    ProofTreeNode *first = local.arena(0) -> make();
+    ProofTreeNode *second = local.arena(0) -> make();
+
+    local.push(0, first);
+    local.push(0, second);
+
+    // The owner takes the oldest node, a thief takes the newest
+    REQUIRE(local.pop(1) == second);
+    REQUIRE(local.pop(0) == first);
+
+    REQUIRE(!local.finish());
+    REQUIRE(local.finish());
+}
+
+static void *fillQueue(void *queue) {
+    for (size_t i = 0; i < 100; i++) ((ThreadQueue*) queue) -> push(nullptr);
+    return NULL;
+}
+
+TEST_CASE("ThreadQueue keeps order and waits for space when full") {
+    ThreadQueue queue(4);
+    ProofTreeNode first;
+    ProofTreeNode second;
+
+    queue.push(&first);
+    queue.push(&second);
+
+    REQUIRE(queue.pop() == &first);
+    REQUIRE(queue.pop() == &second);
+
+    // The producer has to wait for the consumer many times over
+    pthread_t producer;
+    pthread_create(&producer, NULL, fillQueue, &queue);
+
+    for (size_t i = 0; i < 100; i++) queue.pop();
+    pthread_join(producer, NULL);
+
+    queue.push(&first);
+    queue.lock();
+    REQUIRE(queue.pop() == nullptr);
+}
+
+TEST_CASE("Node arenas are reused after a reset") {
+    NodeArena arena;
+    ProofTreeNode *first = arena.make();
+    first -> depth = 3;
+
+    for (size_t i = 0; i < 5000; i++) arena.make();
+    REQUIRE(arena.size() == 5001);
+
+    arena.reset();
+    REQUIRE(arena.size() == 0);
+
+    // The same memory comes back, cleared
+    ProofTreeNode *again = arena.make();
+    REQUIRE(again == first);
+    REQUIRE(again -> depth == 0);
 }
\ No newline at end of file